@@ -87,15 +87,11 @@ int pie_graph( HEZDIMAGE x_hDib, int x, int y, int rad,
 	if ( !pData || 0 >= nDataSize || !pCols || !nCols )
 		return 0;
 
-	// Draw chart outline
-	ezd_circle( x_hDib, x, y, rad, *pCols );
-
 	// Get the range of the data set
 	ezd_calc_range( nDataType, pData, nDataSize, &dMin, &dMax, &dTotal );
 
-	// Draw the pie slices
+	// Fill the pie slices
 	pos = 0; c = 0;
-	ezd_line( x_hDib, x, y, x + rad, y, *pCols );
 	for ( i = 0; i < nDataSize; i++ )
 	{
 		if ( ++c >= nCols )
@@ -104,15 +100,27 @@ int pie_graph( HEZDIMAGE x_hDib, int x, int y, int rad,
 		// Get the value for this element
 		v = ezd_scale_value( i, nDataType, pData, 0, dTotal, 0, PI2 );
 
+		ezd_fill_pie( x_hDib, x, y, rad, pos, pos + v, pCols[ c ] );
+
+		pos += v;
+
+	} // end for
+
+	// Draw chart outline
+	ezd_circle( x_hDib, x, y, rad, *pCols );
+
+	// Draw the slice edges
+	pos = 0;
+	ezd_line( x_hDib, x, y, x + rad, y, *pCols );
+	for ( i = 0; i < nDataSize; i++ )
+	{
+		v = ezd_scale_value( i, nDataType, pData, 0, dTotal, 0, PI2 );
+
 		ezd_line( x_hDib, x, y,
 						  x + (int)( (double)rad * cos( pos + v ) ),
 						  y + (int)( (double)rad * sin( pos + v ) ),
 						  *pCols );
 
-		ezd_flood_fill( x_hDib, x + (int)( (double)rad / (double)2 * cos( pos + v / 2 ) ),
-								y + (int)( (double)rad / (double)2 * sin( pos + v / 2 ) ),
-								*pCols, pCols[ c ] );
-
 		pos += v;
 
 	} // end for
@@ -226,7 +234,7 @@ int main( int argc, char* argv[] )
 		ezd_fill( hDib, 0x404040 );
 
 		// Test fonts
-		hFont = ezd_load_font( EZD_FONT_TYPE_MEDIUM, 0, 0 );
+		hFont = ezd_load_font( EZD_FONT_TYPE_MEDIUM, 0, 0, 0 );
 		if ( hFont )
 			ezd_text( hDib, hFont, "--- EZDIB Test ---", -1, 10, 10, 0xffffff );
 
@@ -361,7 +369,7 @@ int main( int argc, char* argv[] )
 		ezd_set_pixel_callback( hDib, &dotmatrix_writer, hDmd );
 
 		// Draw some text
-		hFont = ezd_load_font( EZD_FONT_TYPE_MEDIUM, 0, 0 );
+		hFont = ezd_load_font( EZD_FONT_TYPE_MEDIUM, 0, 0, 0 );
 		if ( hFont )
 			ezd_text( hDib, hFont, "Hello World!", -1, 4, 4, 0xa0a0a0 );
 
@@ -440,7 +448,7 @@ int main( int argc, char* argv[] )
 		ezd_line( hDib, 30, 10, 30, 11, '|' );
 		
 		// Draw some text
-		hFont = ezd_load_font( EZD_FONT_TYPE_SMALL, 0, 0 );
+		hFont = ezd_load_font( EZD_FONT_TYPE_SMALL, 0, 0, 0 );
 		if ( hFont )
 			ezd_text( hDib, hFont, "The\nEnd", -1, 4, 4, '#' );
 		
@@ -454,6 +462,42 @@ int main( int argc, char* argv[] )
 		printf( "%s\n", ascii );
 			
 	} // end for
-	
+
+	//--------------------------------------------------------------
+	// *** Polygon edges far outside the image
+	//--------------------------------------------------------------
+
+	{
+		// The same triangle with huge and with small coordinates
+		int big[] = { -2000000000, -2000000000, 2000000000, 2000000000, -2000000000, 2000000000 };
+		int small[] = { -2000, -2000, 2000, 2000, -2000, 2000 };
+		int n = 0, diff = 0;
+		HEZDIMAGE hBig = ezd_create( 200, -200, 24, 0 );
+		HEZDIMAGE hSmall = ezd_create( 200, -200, 24, 0 );
+		if ( !hBig || !hSmall )
+			return -1;
+
+		ezd_fill( hBig, 0 );
+		ezd_fill( hSmall, 0 );
+		ezd_fill_polygon( hBig, big, 3, 0xffffff, EZD_FILL_EVENODD );
+		ezd_fill_polygon( hSmall, small, 3, 0xffffff, EZD_FILL_EVENODD );
+
+		// Both should fill the same pixels
+		for ( y = 0; y < 200; y++ )
+			for ( x = 0; x < 200; x++ )
+			{	n += ezd_get_pixel( hSmall, x, y ) ? 1 : 0;
+				diff += ezd_get_pixel( hBig, x, y ) != ezd_get_pixel( hSmall, x, y );
+			} // end for
+
+		printf( "Polygon fill : %d pixels, %d different\n", n, diff );
+
+		ezd_destroy( hBig );
+		ezd_destroy( hSmall );
+
+		if ( diff )
+			return -1;
+
+	}
+
 	return 0;
 }
@@ -44,6 +44,18 @@
 /// DIB file magic number
 #define EZD_MAGIC_NUMBER	0x4d42
 
+/// Size of the largest bmp file headers, with a 256 color palette
+#define EZD_FILE_HEADERS	( 14 + 40 + 256 * 4 )
+
+/// Most bytes the bmp file headers take for bpp bits per pixel, 12 covers the 16 bit color masks
+#define EZD_FILE_HEADERS_BPP( bpp ) ( 14 + 40 + ( EZD_PALETTE_SIZE( bpp ) ? EZD_PALETTE_SIZE( bpp ) : 12 ) )
+
+/// BI_BITFIELDS compression, 16 bit pixels with color masks after the header
+#define EZD_BI_BITFIELDS	3
+
+/// Colors remembered by ezd_nearest()
+#define EZD_NEAREST_CACHE	8
+
 /// Header for a standard dib file (.bmp)
 typedef struct _SDIBFileHeader
 {
@@ -105,12 +117,24 @@ typedef struct _SBitmapInfoHeader
 } SBitmapInfoHeader;
 
 #	define EZD_FLAG_FREE_BUFFER		0x00010000
+#	define EZD_FLAG_MAPPED			0x00020000
+#	define EZD_FLAG_READ_ONLY		0x00040000
+
+/// Non-zero for the pixel depths that can be drawn on
+#	define EZD_VALID_BPP( b ) ( 1 == (b) || 4 == (b) || 8 == (b) || 16 == (b) || 24 == (b) || 32 == (b) )
 
 // Returns non-zero if any color components are greater than the threshold
 #	define EZD_COMPARE_THRESHOLD( c, t ) ( ( c & 0xff ) > t \
 										 || ( ( c >> 8 ) & 0xff ) > t \
 										 || ( ( c >> 16 ) & 0xff ) > t )
 
+/// Flood fill run, the line above or below y is filled next
+typedef struct _SFillSeg
+{
+	int					y, xl, xr, dy;
+
+} SFillSeg;
+
 // This structure contains the memory image
 typedef struct _SImageData
 {
@@ -120,18 +144,82 @@ typedef struct _SImageData
 	/// Color palette for 1 bit images
 	int						colPalette[ 2 ];
 
+	/// The palette in use, colPalette or the 4 and 8 bit palette at the start of pBuffer
+	int						*pPalette;
+
+	/// Colors recently matched to the palette and their indices, see ezd_nearest()
+	int						colNearest[ EZD_NEAREST_CACHE ];
+	unsigned char			uNearest[ EZD_NEAREST_CACHE ];
+
 	/// Threshold color for 1 bit images
 	int						colThreshold;
 
+	/// Image width and height in pixels
+	int						nWidth;
+	int						nHeight;
+
+	/// Bytes per scan line
+	int						nStride;
+
+	/// Bytes per pixel, rounded up
+	int						nPixel;
+
+	/// Row pointer table, or null to calculate rows from nStride
+	unsigned char			**pRows;
+
+	/// Clip rectangle, right and bottom are exclusive
+	int						nClipLeft;
+	int						nClipTop;
+	int						nClipRight;
+	int						nClipBottom;
+
 	/// Image flags
 	unsigned int			uFlags;
 
+	/// Alpha mode, see ezd_set_alpha_mode()
+	int						nAlpha;
+
+	/// First row in pImage and number of rows while rendering bands
+	int						nBandTop;
+	int						nBandRows;
+
+	/// Dirty rects, x1, y1, x2, y2 with right and bottom exclusive
+	int						nDirty;
+	int						rcDirty[ EZD_DIRTY_RECTS ][ 4 ];
+
 	/// User set pixel callback function
 	t_ezd_set_pixel			pfSetPixel;
 
 	/// User data passed to set pixel callback function
 	void					*pSetPixelUser;
 
+	/// User set span callback function
+	t_ezd_set_span			pfSetSpan;
+
+	/// User data passed to set span callback function
+	void					*pSetSpanUser;
+
+	/// User batched set pixels callback function
+	t_ezd_set_pixels		pfSetPixels;
+
+	/// User data passed to set pixels callback function
+	void					*pSetPixelsUser;
+
+	/// Pixel queue for pfSetPixels
+	SEZDPixel				*pQueue;
+
+	/// Size of pQueue
+	int						nQueue;
+
+	/// Number of pixels in pQueue
+	int						nQueued;
+
+	/// Flood fill stack, kept between calls for images from ezd_create()
+	SFillSeg				*pFillStack;
+
+	/// Size of pFillStack
+	int						nFillStack;
+
 	/// User image pointer
 	unsigned char			*pImage;
 
@@ -144,11 +232,201 @@ typedef struct _SImageData
 #	pragma pack( pop )
 #endif
 
+// Make sure the header fits in EZD_HEADER_SIZE
+typedef char ezd_check_header_size[ ( sizeof( SImageData ) <= EZD_HEADER_SIZE ) ? 1 : -1 ];
+
+/// File mapping of an image from ezd_open_mapped(), kept in the image buffer
+typedef struct _SMapInfo
+{
+	/// Start and size of the mapping
+	unsigned char			*pBase;
+	size_t					nSize;
+
+	/// Pixels in the mapping
+	unsigned char			*pPixels;
+
+	/// Non-zero if drawing changes the file
+	int						nShared;
+
+} SMapInfo;
+
+/// Returns where a 4 or 8 bit image keeps its palette, EZD_PALETTE_SIZE() bytes at the start of pBuffer
+#define EZD_OWN_PALETTE( p ) ( (int*)EZD_ALIGN( (size_t)(p)->pBuffer, sizeof( int ) ) )
+
+/// Returns the rest of pBuffer after any palette
+#define EZD_PAST_PALETTE( p ) ( EZD_PALETTE_SIZE( (p)->bih.biBitCount ) \
+								? (unsigned char*)EZD_OWN_PALETTE( p ) + EZD_PALETTE_SIZE( (p)->bih.biBitCount ) \
+								: (p)->pBuffer )
+
+/// Returns the file mapping of an image with EZD_FLAG_MAPPED
+#define EZD_MAP_INFO( p ) ( (SMapInfo*)EZD_ALIGN( (size_t)EZD_PAST_PALETTE( p ), sizeof( void* ) ) )
+
+/// Forgets the colors matched to the palette, call when it changes
+#define EZD_PALETTE_CHANGED( p ) EZD_MEMSET( (char*)(p)->colNearest, 0xff, sizeof( (p)->colNearest ) )
+
+/// Non-zero if the point is inside the clip rect
+#define EZD_IN_CLIP( p, x, y ) ( (p)->nClipLeft <= (x) && (x) < (p)->nClipRight \
+								 && (p)->nClipTop <= (y) && (y) < (p)->nClipBottom )
+
+/// Returns a pointer to row y of the image
+#define EZD_ROW( p, y ) ( (p)->pRows ? (p)->pRows[ y ] : &(p)->pImage[ ( (y) - (p)->nBandTop ) * (p)->nStride ] )
+
+/// Non-zero if row y is in memory, only the current band is while rendering bands
+#define EZD_IN_BAND( p, y ) ( !(p)->nBandRows || ( (p)->nBandTop <= (y) && (y) < (p)->nBandTop + (p)->nBandRows ) )
+
+/// Non-zero if the image draws through user callbacks
+#define EZD_HAS_CALLBACK( p ) ( (p)->pfSetPixel || (p)->pfSetSpan || (p)->pfSetPixels )
+
+/// Non-zero if the image has pixels or callbacks to draw on
+#define EZD_CAN_DRAW( p ) ( !( EZD_FLAG_READ_ONLY & (p)->uFlags ) && ( (p)->pImage || EZD_HAS_CALLBACK( p ) ) )
+
+/// Passes any queued pixels to the user batch callback
+static int ezd_cb_flush( SImageData *p )
+{
+	int n = p->nQueued;
+
+	if ( !n )
+		return 1;
+
+	p->nQueued = 0;
+	return p->pfSetPixels( p->pSetPixelsUser, p->pQueue, n );
+}
+
+/// Passes a single pixel to the user callbacks
+static int ezd_cb_pixel( SImageData *p, int x, int y, int c, int f )
+{
+	// Queue the pixel
+	if ( p->pfSetPixels )
+	{	SEZDPixel *q = &p->pQueue[ p->nQueued++ ];
+		q->x = x, q->y = y, q->c = c, q->f = f;
+		return ( p->nQueued < p->nQueue ) ? 1 : ezd_cb_flush( p );
+	} // end if
+
+	if ( p->pfSetPixel )
+		return p->pfSetPixel( p->pSetPixelUser, x, y, c, f );
+
+	return p->pfSetSpan( p->pSetSpanUser, x, y, 1, c, f );
+}
+
+/// Passes a horizontal run of pixels to the user callbacks
+static int ezd_cb_span( SImageData *p, int x, int y, int len, int c, int f )
+{
+	if ( 0 >= len )
+		return 1;
+
+	// Keep the drawing order
+	if ( p->pfSetSpan )
+		return ezd_cb_flush( p ) && p->pfSetSpan( p->pSetSpanUser, x, y, len, c, f );
+
+	// Fall back to single pixels
+	for ( ; 0 < len; len--, x++ )
+		if ( !ezd_cb_pixel( p, x, y, c, f ) )
+			return 0;
+
+	return 1;
+}
+
+/// Passes a vertical run of pixels to the user callbacks
+static int ezd_cb_vspan( SImageData *p, int x, int y, int len, int c )
+{
+	if ( 0 >= len )
+		return 1;
+
+	// Keep the drawing order
+	if ( p->pfSetSpan )
+		return ezd_cb_flush( p ) && p->pfSetSpan( p->pSetSpanUser, x, y, len, c, EZD_SPAN_VERTICAL );
+
+	// Fall back to single pixels
+	for ( ; 0 < len; len--, y++ )
+		if ( !ezd_cb_pixel( p, x, y, c, 0 ) )
+			return 0;
+
+	return 1;
+}
+
+#if !defined( EZD_NO_MMAP )
+
+/// Maps a whole file into memory, returns its start or zero
+/**
+	If nCreate isn't zero, the file is created with that size and
+	mapped for writing.
+*/
+static unsigned char* ezd_map_file( const char *pFile, unsigned int uFlags, size_t nCreate, size_t *pSize )
+{
+#	if defined( _WIN32 )
+	HANDLE hFile, hMap;
+	LARGE_INTEGER sz;
+	void *pBase = 0;
+	int write = ( nCreate || ( EZD_MAP_WRITE & uFlags ) ) ? 1 : 0;
+	int copy = ( !write && ( EZD_MAP_COPY & uFlags ) ) ? 1 : 0;
+
+	hFile = CreateFileA( pFile, write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, write ? 0 : FILE_SHARE_READ,
+						 0, nCreate ? CREATE_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if ( INVALID_HANDLE_VALUE == hFile )
+		return 0;
+
+	// Creating the mapping sizes a new file
+	sz.QuadPart = (LONGLONG)nCreate;
+	if ( nCreate || ( GetFileSizeEx( hFile, &sz ) && 0 < sz.QuadPart ) )
+	{	hMap = CreateFileMappingA( hFile, 0, write ? PAGE_READWRITE : copy ? PAGE_WRITECOPY : PAGE_READONLY,
+								   (DWORD)( (unsigned long long)sz.QuadPart >> 32 ), (DWORD)sz.QuadPart, 0 );
+
+		// The view keeps the mapping open after the handles are closed
+		if ( hMap )
+		{	pBase = MapViewOfFile( hMap, write ? FILE_MAP_WRITE : copy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0 );
+			CloseHandle( hMap );
+		} // end if
+		*pSize = (size_t)sz.QuadPart;
+	} // end if
+
+	CloseHandle( hFile );
+
+	return (unsigned char*)pBase;
+#	else
+	int fd, write = ( nCreate || ( EZD_MAP_WRITE & uFlags ) ) ? 1 : 0;
+	struct stat st;
+	void *pBase = MAP_FAILED;
+
+	fd = nCreate ? open( pFile, O_RDWR | O_CREAT | O_TRUNC, 0666 ) : open( pFile, write ? O_RDWR : O_RDONLY );
+	if ( 0 > fd )
+		return 0;
+
+	// Size a new file, the mapping stays valid after the file is closed
+	if ( nCreate ? !ftruncate( fd, (off_t)nCreate ) : ( !fstat( fd, &st ) && 0 < st.st_size ) )
+	{	*pSize = nCreate ? nCreate : (size_t)st.st_size;
+		pBase = mmap( 0, *pSize, ( write || ( EZD_MAP_COPY & uFlags ) ) ? PROT_READ | PROT_WRITE : PROT_READ,
+					  write ? MAP_SHARED : MAP_PRIVATE, fd, 0 );
+	} // end if
+
+	close( fd );
+
+	return ( MAP_FAILED == pBase ) ? 0 : (unsigned char*)pBase;
+#	endif
+}
+
+/// Releases a mapping from ezd_map_file()
+static void ezd_unmap_file( unsigned char *pBase, size_t nSize )
+{
+#	if defined( _WIN32 )
+	UnmapViewOfFile( pBase );
+#	else
+	munmap( pBase, nSize );
+#	endif
+}
+
+#endif
+
 void ezd_destroy( HEZDIMAGE x_hDib )
 {
 #if !defined( EZD_NO_ALLOCATION )
 	if ( x_hDib )
 	{	SImageData *p = (SImageData*)x_hDib;
+		if ( p->pFillStack )
+			EZD_free( p->pFillStack ), p->pFillStack = 0;
+#if !defined( EZD_NO_MMAP )
+		if ( ( EZD_FLAG_MAPPED & p->uFlags ) && EZD_MAP_INFO( p )->pBase )
+			ezd_unmap_file( EZD_MAP_INFO( p )->pBase, EZD_MAP_INFO( p )->nSize );
+#endif
 		if ( EZD_FLAG_FREE_BUFFER & p->uFlags )
 			EZD_free( (SImageData*)x_hDib );
 	} // end if
@@ -160,13 +438,154 @@ int ezd_header_size()
 	return sizeof( SImageData );
 }
 
+/// Recalculates the row table after the image pointer changes
+static void ezd_update_rows( SImageData *p )
+{
+	int y, n;
+
+	if ( !p->pRows || !p->pImage )
+		return;
+
+	// Only the rows in memory
+	n = p->nBandRows ? p->nBandRows : p->nHeight;
+	for ( y = 0; y < n; y++ )
+		p->pRows[ p->nBandTop + y ] = &p->pImage[ y * p->nStride ];
+}
+
+/// Adds a rect to the dirty list
+static void ezd_add_dirty( SImageData *p, int l, int t, int r, int b )
+{
+	int i, n, best;
+	long long a, grow, least;
+
+	// Already covered?
+	for ( i = 0; i < p->nDirty; i++ )
+		if ( p->rcDirty[ i ][ 0 ] <= l && p->rcDirty[ i ][ 1 ] <= t
+			 && p->rcDirty[ i ][ 2 ] >= r && p->rcDirty[ i ][ 3 ] >= b )
+			return;
+
+	// Drop rects this one covers
+	for ( i = 0, n = 0; i < p->nDirty; i++ )
+		if ( l > p->rcDirty[ i ][ 0 ] || t > p->rcDirty[ i ][ 1 ]
+			 || r < p->rcDirty[ i ][ 2 ] || b < p->rcDirty[ i ][ 3 ] )
+		{	if ( n != i )
+				EZD_MEMCPY( (char*)p->rcDirty[ n ], (const char*)p->rcDirty[ i ], sizeof( p->rcDirty[ 0 ] ) );
+			n++;
+		} // end if
+	p->nDirty = n;
+
+	if ( EZD_DIRTY_RECTS > n )
+	{	p->rcDirty[ n ][ 0 ] = l, p->rcDirty[ n ][ 1 ] = t;
+		p->rcDirty[ n ][ 2 ] = r, p->rcDirty[ n ][ 3 ] = b;
+		p->nDirty++;
+		return;
+	} // end if
+
+	// Grow the rect that needs the least extra area
+	for ( i = 0, best = 0, least = 0; i < n; i++ )
+	{	int *d = p->rcDirty[ i ];
+		a = (long long)( d[ 2 ] - d[ 0 ] ) * ( d[ 3 ] - d[ 1 ] );
+		grow = (long long)( ( r > d[ 2 ] ? r : d[ 2 ] ) - ( l < d[ 0 ] ? l : d[ 0 ] ) )
+			   * ( ( b > d[ 3 ] ? b : d[ 3 ] ) - ( t < d[ 1 ] ? t : d[ 1 ] ) ) - a;
+		if ( !i || grow < least )
+			best = i, least = grow;
+	} // end for
+
+	if ( l < p->rcDirty[ best ][ 0 ] ) p->rcDirty[ best ][ 0 ] = l;
+	if ( t < p->rcDirty[ best ][ 1 ] ) p->rcDirty[ best ][ 1 ] = t;
+	if ( r > p->rcDirty[ best ][ 2 ] ) p->rcDirty[ best ][ 2 ] = r;
+	if ( b > p->rcDirty[ best ][ 3 ] ) p->rcDirty[ best ][ 3 ] = b;
+}
+
+/// Marks the part of a box inside the clip rect as drawn on
+static void ezd_dirty( SImageData *p, long long l, long long t, long long r, long long b )
+{
+	if ( l < p->nClipLeft ) l = p->nClipLeft;
+	if ( t < p->nClipTop ) t = p->nClipTop;
+	if ( r > p->nClipRight ) r = p->nClipRight;
+	if ( b > p->nClipBottom ) b = p->nClipBottom;
+
+	if ( l < r && t < b )
+		ezd_add_dirty( p, (int)l, (int)t, (int)r, (int)b );
+}
+
+/// Marks the box around a list of points as drawn on
+static void ezd_dirty_points( SImageData *p, const int *pXy, int nPts )
+{
+	int i, l, t, r, b;
+
+	if ( 0 >= nPts )
+		return;
+
+	l = r = pXy[ 0 ], t = b = pXy[ 1 ];
+	for ( i = 1; i < nPts; i++ )
+	{	if ( pXy[ i * 2 ] < l ) l = pXy[ i * 2 ];
+		else if ( pXy[ i * 2 ] > r ) r = pXy[ i * 2 ];
+		if ( pXy[ i * 2 + 1 ] < t ) t = pXy[ i * 2 + 1 ];
+		else if ( pXy[ i * 2 + 1 ] > b ) b = pXy[ i * 2 + 1 ];
+	} // end for
+
+	ezd_dirty( p, l, t, r + 1LL, b + 1LL );
+}
+
+/// Returns where the image goes in the buffer after the header
+static unsigned char* ezd_own_image( SImageData *p )
+{
+	unsigned char *pImg = EZD_PAST_PALETTE( p );
+
+	// Pixels in a mapped file
+	if ( EZD_FLAG_MAPPED & p->uFlags )
+		return EZD_MAP_INFO( p )->pPixels;
+
+	// Leave room for the file headers
+	if ( EZD_FLAG_FILE_HEADROOM & p->uFlags )
+		pImg += EZD_FILE_HEADERS_BPP( p->bih.biBitCount );
+
+	// Align the pixels when the buffer has room for it
+	if ( ( EZD_FLAG_FILE_HEADROOM | EZD_FLAG_FREE_BUFFER ) & p->uFlags )
+		pImg = (unsigned char*)EZD_ALIGN( (size_t)pImg, 16 );
+
+	return pImg;
+}
+
+/// Fills in the default palette of a 4 or 8 bit image
+static void ezd_default_palette( SImageData *p )
+{
+	int i, v;
+	static const int vga[ 16 ] =
+	{	0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080, 0x008080, 0xc0c0c0,
+		0x808080, 0xff0000, 0x00ff00, 0xffff00, 0x0000ff, 0xff00ff, 0x00ffff, 0xffffff
+	};
+
+	if ( 4 == p->bih.biBitCount )
+	{	EZD_MEMCPY( (char*)p->pPalette, (const char*)vga, sizeof( vga ) );
+		return;
+	} // end if
+
+	// 6x6x6 color cube
+	for ( i = 0; i < 216; i++ )
+		p->pPalette[ i ] = ( ( i / 36 ) * 51 << 16 ) | ( ( i / 6 % 6 ) * 51 << 8 ) | ( i % 6 ) * 51;
+
+	// Gray ramp
+	for ( ; i < 256; i++ )
+		v = ( i - 216 ) * 255 / 39, p->pPalette[ i ] = ( v << 16 ) | ( v << 8 ) | v;
+}
+
+/// Returns the size of the image pixels, or zero if it would not fit in an int
+static int ezd_image_size( int w, int h, int bpp )
+{
+	long long n = EZD_IMAGE_SIZE( (long long)w, (long long)h, bpp, 4 );
+
+	return ( 0 < n && 0x7fffffffLL >= n ) ? (int)n : 0;
+}
+
 HEZDIMAGE ezd_initialize( void *x_pBuffer, int x_nBuffer, int x_lWidth, int x_lHeight, int x_lBpp, unsigned int x_uFlags )
 {
 	int nImageSize;
 	SImageData *p;
 
-	// Ensure the user buffer is acceptable
-	if ( !x_pBuffer || ( 0 < x_nBuffer && sizeof( SImageData ) > x_nBuffer ) )
+	// Ensure the user buffer is acceptable, 4 and 8 bit images keep their palette after the header
+	if ( !x_pBuffer || ( 0 < x_nBuffer && sizeof( SImageData ) + EZD_PALETTE_SIZE( x_lBpp ) > (size_t)x_nBuffer ) )
 		return _ERR( (HEZDIMAGE)0, "Invalid header buffer" );
 
 	// Sanity check
@@ -174,9 +593,9 @@ HEZDIMAGE ezd_initialize( void *x_pBuffer, int x_nBuffer, int x_lWidth, int x_lH
 		return _ERR( (HEZDIMAGE)0, "Invalid parameters" );
 
 	// Calculate image size
-	nImageSize = EZD_IMAGE_SIZE( x_lWidth, x_lHeight, x_lBpp, 4 );
+	nImageSize = ezd_image_size( x_lWidth, x_lHeight, x_lBpp );
 	if ( 0 >= nImageSize )
-		return _ERR( (HEZDIMAGE)0, "Invalid bits per pixel" );
+		return _ERR( (HEZDIMAGE)0, "Invalid bits per pixel or image too large" );
 
 	// Point to users buffer
 	p = (SImageData*)x_pBuffer;
@@ -192,7 +611,18 @@ HEZDIMAGE ezd_initialize( void *x_pBuffer, int x_nBuffer, int x_lWidth, int x_lH
 	p->bih.biBitCount = x_lBpp;
 	p->bih.biSizeImage = nImageSize;
 
+	// Cache the geometry
+	p->nWidth = EZD_ABS( x_lWidth );
+	p->nHeight = EZD_ABS( x_lHeight );
+	p->nStride = EZD_SCANWIDTH( x_lWidth, x_lBpp, 4 );
+	p->nPixel = EZD_FITTO( x_lBpp, 8 );
+
+	// Draw on the whole image
+	p->nClipRight = p->nWidth;
+	p->nClipBottom = p->nHeight;
+
 	// Initialize color palette
+	p->pPalette = EZD_PALETTE_SIZE( x_lBpp ) ? EZD_OWN_PALETTE( p ) : p->colPalette;
 	if ( 1 == x_lBpp )
 	{	p->bih.biClrUsed = 2;
 		p->bih.biClrImportant = 2;
@@ -200,46 +630,89 @@ HEZDIMAGE ezd_initialize( void *x_pBuffer, int x_nBuffer, int x_lWidth, int x_lH
 		p->colPalette[ 1 ] = 0xffffff;
 	} // end if
 
-	// Point image buffer
-	p->pImage = ( EZD_FLAG_USER_IMAGE_BUFFER & x_uFlags ) ? 0 : p->pBuffer;
+	else if ( 4 == x_lBpp || 8 == x_lBpp )
+	{	p->bih.biClrUsed = 1 << x_lBpp;
+		ezd_default_palette( p );
+	} // end else if
+
+	// 5-6-5 pixels need color masks in the file
+	else if ( 16 == x_lBpp && !( EZD_FLAG_RGB555 & x_uFlags ) )
+		p->bih.biCompression = EZD_BI_BITFIELDS;
+
+	// Nothing has been matched to the palette
+	EZD_PALETTE_CHANGED( p );
 
 	// Save the flags
 	p->uFlags = x_uFlags;
 
+	// Point image buffer
+	p->pImage = ( EZD_FLAG_USER_IMAGE_BUFFER & x_uFlags ) ? 0 : ezd_own_image( p );
+
 	return (HEZDIMAGE)p;
 }
 
 
-HEZDIMAGE ezd_create( int x_lWidth, int x_lHeight, int x_lBpp, unsigned int x_uFlags )
+#if !defined( EZD_NO_ALLOCATION )
+
+/// Allocates an image, x_uFlags can include internal flags
+static SImageData* ezd_create_image( int x_lWidth, int x_lHeight, int x_lBpp, unsigned int x_uFlags )
 {
-#if defined( EZD_NO_ALLOCATION )
-	return 0;
-#else
-	int nImageSize;
+	size_t nImageSize;
 	SImageData *p;
 
-	// Make sure the caller isn't stepping on our internal flags
-	if ( 0xffff0000 & x_uFlags )
-		return _ERR( (HEZDIMAGE)0, "You have specified invalid flags" );
-
 	// Sanity check
 	if ( !x_lWidth || !x_lHeight )
-		return _ERR( (HEZDIMAGE)0, "Invalid image width or height" );
+		return _ERR( (SImageData*)0, "Invalid image width or height" );
 
 	// Calculate image size
-	nImageSize = EZD_IMAGE_SIZE( x_lWidth, x_lHeight, x_lBpp, 4 );
-	if ( 0 >= nImageSize )
-		return _ERR( (HEZDIMAGE)0, "Invalid bits per pixel" );
-
-	// Allocate memory
-	p = (SImageData*)EZD_malloc( sizeof( SImageData )
-								 + ( ( EZD_FLAG_USER_IMAGE_BUFFER & x_uFlags ) ? 0 : nImageSize ) );
+	nImageSize = (size_t)ezd_image_size( x_lWidth, x_lHeight, x_lBpp );
+	if ( !nImageSize )
+		return _ERR( (SImageData*)0, "Invalid bits per pixel or image too large" );
+
+	// Room for the image and an aligned row table after it
+	if ( EZD_FLAG_MAPPED & x_uFlags )
+		nImageSize = sizeof( SMapInfo ) + sizeof( void* );
+	else if ( EZD_FLAG_USER_IMAGE_BUFFER & x_uFlags )
+		nImageSize = 0;
+	else if ( EZD_FLAG_FILE_HEADROOM & x_uFlags )
+		nImageSize += EZD_FILE_HEADROOM + EZD_PALETTE_SIZE( x_lBpp );
+	else
+		nImageSize += 16;
+	nImageSize = EZD_ALIGN( nImageSize, sizeof( void* ) );
+
+	// Allocate memory, the palette goes between the header and the image
+	p = (SImageData*)EZD_malloc( sizeof( SImageData ) + EZD_PALETTE_SIZE( x_lBpp ) + nImageSize
+								 + ( EZD_ABS( x_lHeight ) + 1 ) * sizeof( unsigned char* ) );
 
 	if ( !p )
 		return 0;
 
 	// Initialize the header
-	return ezd_initialize( p, sizeof( SImageData ), x_lWidth, x_lHeight, x_lBpp, x_uFlags | EZD_FLAG_FREE_BUFFER );
+	if ( !ezd_initialize( p, (int)( sizeof( SImageData ) + EZD_PALETTE_SIZE( x_lBpp ) ),
+						  x_lWidth, x_lHeight, x_lBpp, x_uFlags | EZD_FLAG_FREE_BUFFER ) )
+	{	EZD_free( p );
+		return 0;
+	} // end if
+
+	// Point the row table past the image
+	p->pRows = (unsigned char**)EZD_ALIGN( (size_t)&EZD_PAST_PALETTE( p )[ nImageSize ], sizeof( void* ) );
+	ezd_update_rows( p );
+
+	return p;
+}
+
+#endif
+
+HEZDIMAGE ezd_create( int x_lWidth, int x_lHeight, int x_lBpp, unsigned int x_uFlags )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	// Make sure the caller isn't stepping on our internal flags
+	if ( 0xffff0000 & x_uFlags )
+		return _ERR( (HEZDIMAGE)0, "You have specified invalid flags" );
+
+	return (HEZDIMAGE)ezd_create_image( x_lWidth, x_lHeight, x_lBpp, x_uFlags );
 #endif
 }
 
@@ -255,1344 +728,5739 @@ int ezd_set_image_buffer( HEZDIMAGE x_hDib, void *x_pImg, int x_nImg )
 
 	// Save user image pointer
 	p->pImage = ( !x_pImg && !( EZD_FLAG_USER_IMAGE_BUFFER & p->uFlags ) )
-				? p->pBuffer : x_pImg;
+				? ezd_own_image( p ) : x_pImg;
+	ezd_update_rows( p );
+
 	return 1;
 }
 
-int ezd_set_pixel_callback( HEZDIMAGE x_hDib, t_ezd_set_pixel x_pf, void *x_pUser )
+int ezd_render_bands( HEZDIMAGE x_hDib, void *x_pBand, int x_nBand,
+					  t_ezd_draw x_pfDraw, void *x_pDrawUser, t_ezd_band x_pfBand, void *x_pBandUser )
 {
+	int y, n, rows, ok, l, t, r, b;
+	unsigned char *pImage;
 	SImageData *p = (SImageData*)x_hDib;
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !x_pBand || !x_pfDraw || !x_pfBand || p->nBandRows )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Save user callback info
-	p->pfSetPixel = x_pf;
-	p->pSetPixelUser = x_pUser;
+	// Whole scan lines that fit in the band buffer
+	rows = x_nBand / p->nStride;
+	if ( 0 >= rows )
+		return _ERR( 0, "Band buffer is smaller than a scan line" );
 
-	return 1;
-}
+	// Save the image buffer and clip rect
+	pImage = p->pImage;
+	l = p->nClipLeft, t = p->nClipTop, r = p->nClipRight, b = p->nClipBottom;
 
+	for ( y = 0, ok = 1; ok && y < p->nHeight; y += rows )
+	{
+		n = ( p->nHeight - y < rows ) ? p->nHeight - y : rows;
 
-int ezd_set_palette_color( HEZDIMAGE x_hDib, int x_idx, int x_col )
-{
-	SImageData *p = (SImageData*)x_hDib;
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
-		return _ERR( 0, "Invalid parameters" );
+		// Map rows y to y + n - 1 onto the band buffer and clip to them
+		p->pImage = (unsigned char*)x_pBand;
+		p->nBandTop = y, p->nBandRows = n;
+		ezd_update_rows( p );
+		ezd_set_clip_rect( x_hDib, l, t, r, b );
 
-	if ( 0 > x_idx || 1 < x_idx )
-		return _ERR( 0, "Palette index out of range" );
+		// Draw the frame and pass on the band
+		ok = x_pfDraw( x_pDrawUser, x_hDib )
+			 && x_pfBand( x_pBandUser, x_hDib, y, n, x_pBand );
 
-	// Set this palette color
-	p->colPalette[ x_idx ] = x_col;
+	} // end for
 
-	return 1;
+	// Restore the image
+	p->nBandTop = p->nBandRows = 0;
+	p->pImage = pImage;
+	ezd_update_rows( p );
+	p->nClipLeft = l, p->nClipTop = t, p->nClipRight = r, p->nClipBottom = b;
+
+	return ok;
 }
 
-int ezd_get_palette_color( HEZDIMAGE x_hDib, int x_idx, int x_col )
+int ezd_set_pixel_callback( HEZDIMAGE x_hDib, t_ezd_set_pixel x_pf, void *x_pUser )
 {
 	SImageData *p = (SImageData*)x_hDib;
 	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	if ( 0 > x_idx || 1 < x_idx )
-		return _ERR( 0, "Palette index out of range" );
+	// Save user callback info
+	p->pfSetPixel = x_pf;
+	p->pSetPixelUser = x_pUser;
 
-	// Return this palette color
-	return p->colPalette[ x_idx ];
+	return 1;
 }
 
-int* ezd_get_palette( HEZDIMAGE x_hDib )
+int ezd_set_span_callback( HEZDIMAGE x_hDib, t_ezd_set_span x_pf, void *x_pUser )
 {
 	SImageData *p = (SImageData*)x_hDib;
 	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
-		return _ERR( (int*)0, "Invalid parameters" );
+		return _ERR( 0, "Invalid parameters" );
 
-	// Return a pointer to the palette
-	return p->colPalette;
+	// Save user callback info
+	p->pfSetSpan = x_pf;
+	p->pSetSpanUser = x_pUser;
+
+	return 1;
 }
 
-int ezd_get_palette_size( HEZDIMAGE x_hDib )
+int ezd_set_pixels_callback( HEZDIMAGE x_hDib, t_ezd_set_pixels x_pf, void *x_pUser, SEZDPixel *x_pBuf, int x_nBuf )
 {
 	SImageData *p = (SImageData*)x_hDib;
 	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	switch( p->bih.biBitCount )
-	{
-		case 1 :
-			return 2;
-	} // end switch
+	// Need a queue to batch pixels
+	if ( x_pf && ( !x_pBuf || 0 >= x_nBuf ) )
+		return _ERR( 0, "Invalid pixel queue" );
 
-	return 0;
+	// Save user callback info
+	p->pfSetPixels = x_pf;
+	p->pSetPixelsUser = x_pUser;
+	p->pQueue = x_pf ? x_pBuf : 0;
+	p->nQueue = x_pf ? x_nBuf : 0;
+	p->nQueued = 0;
+
+	return 1;
 }
 
-int ezd_set_color_threshold( HEZDIMAGE x_hDib, int x_col )
+
+int ezd_set_clip_rect( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2 )
 {
 	SImageData *p = (SImageData*)x_hDib;
 	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate scan width
-	p->colThreshold = x_col;
+	// Swap coords if needed
+	if ( x1 > x2 ) { int t = x1; x1 = x2; x2 = t; }
+	if ( y1 > y2 ) { int t = y1; y1 = y2; y2 = t; }
+
+	// Keep it on the image
+	if ( 0 > x1 ) x1 = 0;
+	if ( 0 > y1 ) y1 = 0;
+	if ( x2 > p->nWidth ) x2 = p->nWidth;
+	if ( y2 > p->nHeight ) y2 = p->nHeight;
+
+	// And in the current band
+	if ( p->nBandRows )
+	{	if ( y1 < p->nBandTop ) y1 = p->nBandTop;
+		if ( y2 > p->nBandTop + p->nBandRows ) y2 = p->nBandTop + p->nBandRows;
+	} // end if
+
+	if ( x1 > x2 ) x1 = x2;
+	if ( y1 > y2 ) y1 = y2;
+
+	p->nClipLeft = x1;
+	p->nClipTop = y1;
+	p->nClipRight = x2;
+	p->nClipBottom = y2;
 
 	return 1;
 }
 
-int ezd_get_width( HEZDIMAGE x_hDib )
+int ezd_reset_clip_rect( HEZDIMAGE x_hDib )
 {
 	SImageData *p = (SImageData*)x_hDib;
 	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate scan width
-	return p->bih.biWidth;
+	return ezd_set_clip_rect( x_hDib, 0, 0, p->nWidth, p->nHeight );
 }
 
-int ezd_get_height( HEZDIMAGE x_hDib )
+int ezd_get_dirty_rects( HEZDIMAGE x_hDib, int *x_pRects, int x_nMax )
 {
+	int i;
 	SImageData *p = (SImageData*)x_hDib;
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate scan width
-	return p->bih.biHeight;
+	for ( i = 0; x_pRects && i < x_nMax && i < p->nDirty; i++ )
+		EZD_MEMCPY( (char*)&x_pRects[ i * 4 ], (const char*)p->rcDirty[ i ], sizeof( p->rcDirty[ 0 ] ) );
+
+	return p->nDirty;
 }
 
-int ezd_get_bpp( HEZDIMAGE x_hDib )
+int ezd_clear_dirty( HEZDIMAGE x_hDib )
 {
 	SImageData *p = (SImageData*)x_hDib;
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate scan width
-	return p->bih.biBitCount;
+	p->nDirty = 0;
+
+	return 1;
 }
 
-int ezd_get_image_size( HEZDIMAGE x_hDib )
+//------------------------------------------------------------------
+// Pixel values
+//------------------------------------------------------------------
+
+/// Returns the number of palette colors, or zero if the image has no palette
+/**
+	4 and 8 bit files can have fewer colors than the pixels can
+	index, biClrUsed holds how many.
+*/
+static int ezd_palette_size( SImageData *p )
 {
-	SImageData *p = (SImageData*)x_hDib;
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
-		return _ERR( 0, "Invalid parameters" );
+	int n;
 
-	// Calculate scan width
-	return p->bih.biSizeImage;
-}
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			return 2;
 
+		case 4 :
+		case 8 :
+			n = 1 << p->bih.biBitCount;
+			return ( p->bih.biClrUsed && (int)p->bih.biClrUsed < n ) ? (int)p->bih.biClrUsed : n;
 
-void* ezd_get_image_ptr( HEZDIMAGE x_hDib )
-{
-	SImageData *p = (SImageData*)x_hDib;
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
-		return _ERR( (void*)0, "Invalid parameters" );
+	} // end switch
 
-	// Calculate scan width
-	return p->pImage;
+	return 0;
 }
 
-
-int ezd_save( HEZDIMAGE x_hDib, const char *x_pFile )
+/// Returns the index of the palette color nearest col
+/**
+	Drawing repeats the same few colors, so the last ones matched
+	are kept in a small hash table in the image.
+*/
+static int ezd_nearest( SImageData *p, int col )
 {
-#if defined( EZD_NO_FILES )
-	return 0;
-#else
-	FILE *fh;
-	int palette_size = 0;
-	SDIBFileHeader dfh;
-	SImageData *p = (SImageData*)x_hDib;
+	int i, n, d, dr, dg, db, best, least;
+	unsigned int h;
+
+	col &= 0xffffff;
+	h = ( ( (unsigned int)col * 2654435761u ) >> 24 ) % EZD_NEAREST_CACHE;
+	if ( col == p->colNearest[ h ] )
+		return p->uNearest[ h ];
+
+	n = ezd_palette_size( p );
+	for ( i = 0, best = 0, least = 0x7fffffff; i < n && least; i++ )
+	{	dr = ( ( col >> 16 ) & 0xff ) - ( ( p->pPalette[ i ] >> 16 ) & 0xff );
+		dg = ( ( col >> 8 ) & 0xff ) - ( ( p->pPalette[ i ] >> 8 ) & 0xff );
+		db = ( col & 0xff ) - ( p->pPalette[ i ] & 0xff );
+
+		// Weighted roughly for how bright each component looks
+		d = 3 * dr * dr + 4 * dg * dg + 2 * db * db;
+		if ( d < least )
+			best = i, least = d;
+	} // end for
 
-	// Sanity checks
-	if ( !x_pFile || !*x_pFile || !p )
-		return _ERR( 1, "Invalid parameters" );
+	p->colNearest[ h ] = col, p->uNearest[ h ] = (unsigned char)best;
 
-	// User image conversion
-	if (!p->pImage)
+	return best;
+}
+
+/// Returns the pixel value of a color in a 1, 4, 8 or 16 bit image, other images use the color
+static unsigned int ezd_color_px( SImageData *p, int col )
+{
+	switch( p->bih.biBitCount )
 	{
-		if (!p->pfSetPixel)
-			return _ERR(2, "Invalid parameters");
-		int x, y, w, h;
-		w = EZD_ABS(p->bih.biWidth);
-		h = EZD_ABS(p->bih.biHeight);
-		HEZDIMAGE hdib = ezd_create(w, -h, 24, 0);
-		if (hdib)
-		{
-			//ezd_set_color_threshold(hdib, p->colThreshold);
-			//ezd_set_palette_color(hdib, 0, 0x000000);
-			//ezd_set_palette_color(hdib, 1, 0xffffff);
-			ezd_fill(hdib, 0);
-			// Write the Image data
-			for (y = 0; y < h; y++)
-			{
-				for (x = 0; x < w; x++)
-				{
-					// fastest hack reverse set function with negative flag
-					int pixel = p->pfSetPixel(p->pSetPixelUser, x, y, 0xffffff, -1);
-					if (pixel)
-						ezd_set_pixel(hdib, x, y, pixel);
-				}
-			}
-			ezd_save(hdib, x_pFile);
-			ezd_destroy(hdib);
-		}
-		else
-			return _ERR(0, "Could not allocate image");
+		case 1 :
+			return EZD_COMPARE_THRESHOLD( col, p->colThreshold ) ? 1 : 0;
 
-		return 1;
-	}
-	else if (sizeof(SBitmapInfoHeader) != p->bih.biSize)
-		return _ERR(3, "Invalid parameters");
+		case 4 :
+		case 8 :
+			return ezd_nearest( p, col );
 
-	
+		case 16 :
+			if ( EZD_FLAG_RGB555 & p->uFlags )
+				return ( ( col >> 9 ) & 0x7c00 ) | ( ( col >> 6 ) & 0x03e0 ) | ( ( col >> 3 ) & 0x001f );
+			return ( ( col >> 8 ) & 0xf800 ) | ( ( col >> 5 ) & 0x07e0 ) | ( ( col >> 3 ) & 0x001f );
 
-	// Ensure packing is ok
-	if ( sizeof( SDIBFileHeader ) != 14 )
-		return _ERR( 0, "Structure packing for DIB header is incorrect" );
+	} // end switch
 
-	// Ensure packing is ok
-	if ( sizeof( SBitmapInfoHeader ) != 40 )
-		return _ERR( 0, "Structure packing for BITMAP header is incorrect" );
+	return (unsigned int)col;
+}
 
-	// Add palettte size
-	if ( 1 == p->bih.biBitCount )
-		palette_size = sizeof( p->colPalette[ 0 ] ) * 2;
+/// Returns the color of a pixel value from ezd_color_px()
+static int ezd_px_color( SImageData *p, unsigned int v )
+{
+	int r, g, b;
 
-	// Attempt to open the output file
-	fh = fopen ( x_pFile, "wb" );
-	if ( !fh )
-		return _ERR( 0, "Failed to open DIB file for writing" );
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+		case 4 :
+		case 8 :
+			return p->pPalette[ v ];
 
-	// Fill in header info
-	dfh.uMagicNumber = EZD_MAGIC_NUMBER;
-	dfh.uSize = sizeof( SDIBFileHeader ) + p->bih.biSize + p->bih.biSizeImage;
-	dfh.uReserved1 = 0;
-	dfh.uReserved2 = 0;
-	dfh.uOffset = sizeof( SDIBFileHeader ) + p->bih.biSize + palette_size;
+		case 16 :
+			if ( EZD_FLAG_RGB555 & p->uFlags )
+				r = ( v >> 7 ) & 0xf8, g = ( v >> 2 ) & 0xf8, b = ( v << 3 ) & 0xf8;
+			else
+				r = ( v >> 8 ) & 0xf8, g = ( v >> 3 ) & 0xfc, b = ( v << 3 ) & 0xf8;
+
+			// Repeat the top bits so white stays white
+			r |= r >> 5, g |= ( EZD_FLAG_RGB555 & p->uFlags ) ? g >> 5 : g >> 6, b |= b >> 5;
+			return ( r << 16 ) | ( g << 8 ) | b;
 
-	// Write the header
-	if ( sizeof( dfh ) != fwrite( &dfh, 1, sizeof( dfh ), fh ) )
-	{	fclose( fh ); return _ERR( 0, "Error writing DIB header" ); }
+	} // end switch
 
-	// Write the Bitmap header
-	if ( p->bih.biSize != fwrite( &p->bih, 1, p->bih.biSize, fh ) )
-	{	fclose( fh ); return _ERR( 0, "Error writing bitmap header" ); }
+	return (int)v;
+}
 
-	// Write the color palette if needed
-	if (0 < palette_size)
+/// Returns the value of pixel x in a 1, 4, 8 or 16 bit image row
+static unsigned int ezd_get_v( SImageData *p, const unsigned char *pRow, int x )
+{
+	switch( p->bih.biBitCount )
 	{
-		if (sizeof(p->colPalette) != fwrite(p->colPalette, 1, palette_size, fh))
-		{
-			fclose(fh); return _ERR(0, "Error writing palette");
-		}
-	}
+		case 1 :
+			return ( pRow[ x >> 3 ] >> ( 7 - ( x & 7 ) ) ) & 1;
 
-	// Write the Image data
-	if ( p->bih.biSizeImage != fwrite( p->pImage, 1, p->bih.biSizeImage, fh ) )
-	{	fclose( fh ); return _ERR( 0, "Error writing image data" ); }
+		case 4 :
+			return ( x & 1 ) ? pRow[ x >> 1 ] & 0x0f : pRow[ x >> 1 ] >> 4;
 
-	// Close the file handle
-	fclose( fh );
+		case 8 :
+			return pRow[ x ];
 
-	return 1;
-#endif
+		case 16 :
+			return pRow[ x * 2 ] | ( pRow[ x * 2 + 1 ] << 8 );
+
+	} // end switch
+
+	return 0;
 }
 
-int ezd_fill( HEZDIMAGE x_hDib, int x_col )
+int ezd_set_palette_color( HEZDIMAGE x_hDib, int x_idx, int x_col )
 {
-	int w, h, sw, pw, x, y;
+	int n;
 	SImageData *p = (SImageData*)x_hDib;
-
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize 
-		 || ( !p->pImage && !p->pfSetPixel ) )
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
-
-	// Check for user callback function
-	if ( p->pfSetPixel )
-	{
-		// Fill each pixel
-		for ( y = 0; y < h; y++ )
-			for( x = 0; x < w; x++ )
-				if ( !p->pfSetPixel( p->pSetPixelUser, x, y, x_col, 0 ) )
-					return 0;
+	// Images without a palette still keep two colors
+	n = ezd_palette_size( p );
+	if ( 0 > x_idx || x_idx >= ( n ? n : 2 ) )
+		return _ERR( 0, "Palette index out of range" );
 
-		return 1;
+	// Set this palette color
+	p->pPalette[ x_idx ] = x_col;
+	EZD_PALETTE_CHANGED( p );
 
-	} // end if
+	return 1;
+}
 
-	// Pixel and scan widths
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 4 );
+int ezd_get_palette_color( HEZDIMAGE x_hDib, int x_idx, int x_col )
+{
+	int n;
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-	// Set the first line
-	switch( p->bih.biBitCount )
-	{
-		case 1 :
-			EZD_MEMSET( p->pImage, EZD_COMPARE_THRESHOLD( x_col, p->colThreshold ) ? 0xff : 0, sw );
-			break;
+	n = ezd_palette_size( p );
+	if ( 0 > x_idx || x_idx >= ( n ? n : 2 ) )
+		return _ERR( 0, "Palette index out of range" );
 
-		case 24 :
-		{
-			// Color values
-			unsigned char r = x_col & 0xff;
-			unsigned char g = ( x_col >> 8 ) & 0xff;
-			unsigned char b = ( x_col >> 16 ) & 0xff;
-			unsigned char *pImg = p->pImage;
+	// Return this palette color
+	return p->pPalette[ x_idx ];
+}
 
-			// Set the first line
-			for( x = 0; x < w; x++, pImg += pw )
-				pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
+int* ezd_get_palette( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( (int*)0, "Invalid parameters" );
 
-		} break;
+	// The caller may change it
+	EZD_PALETTE_CHANGED( p );
 
-		case 32 :
-		{
-			// Set the first line
-			int *pImg = (int*)p->pImage;
-			for( x = 0; x < w; x++, pImg++ )
-				*pImg = x_col;
+	// Return a pointer to the palette
+	return p->pPalette;
+}
 
-		} break;
+int ezd_get_palette_size( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-		default :
-			return 0;
+	return ezd_palette_size( p );
+}
 
-	} // end switch
+int ezd_set_color_threshold( HEZDIMAGE x_hDib, int x_col )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-	// Copy remaining lines
-	for( y = 1; y < h; y++ )
-		EZD_MEMCPY( &p->pImage[ y * sw ], p->pImage, sw );
+	// Calculate scan width
+	p->colThreshold = x_col;
 
 	return 1;
 }
 
-int ezd_set_pixel( HEZDIMAGE x_hDib, int x, int y, int x_col )
+int ezd_set_alpha_mode( HEZDIMAGE x_hDib, int x_nMode )
 {
-	int w, h, sw, pw;
 	SImageData *p = (SImageData*)x_hDib;
-
 	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
-		 || ( !p->pImage && !p->pfSetPixel ) )
+		 || EZD_ALPHA_NONE > x_nMode || EZD_ALPHA_PREMULTIPLIED < x_nMode )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
+	if ( EZD_ALPHA_NONE != x_nMode && 32 != p->bih.biBitCount )
+		return _ERR( 0, "Alpha modes need a 32 bit image" );
 
-	// Ensure pixel is within the image
-	if ( 0 > x || x >= w || 0 > y || y >= h )
-	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, w, h );
-		return 0;
-	} // en dif
-
-	// Set the specified pixel
-	if ( p->pfSetPixel )
-		return p->pfSetPixel( p->pSetPixelUser, x, y, x_col, 0 );
+	p->nAlpha = x_nMode;
 
-	// Pixel and scan width
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 4 );
+	return 1;
+}
 
-	// Set the first line
-	switch( p->bih.biBitCount )
-	{
-		case 1 :
-			p->pImage[ y * sw + ( x >> 3 ) ] |= 0x80 >> ( x & 7 );
-			break;
+int ezd_get_width( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-		case 24 :
-		{
-			// Color values
-			unsigned char r = x_col & 0xff;
-			unsigned char g = ( x_col >> 8 ) & 0xff;
-			unsigned char b = ( x_col >> 16 ) & 0xff;
-			unsigned char *pImg = &p->pImage[ y * sw + x * pw ];
+	// Calculate scan width
+	return p->bih.biWidth;
+}
 
-			// Set the pixel color
-			pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
+int ezd_get_height( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-		} break;
+	// Calculate scan width
+	return p->bih.biHeight;
+}
 
-		case 32 :
-			*(unsigned int*)&p->pImage[ y * sw + x * pw ] = x_col;
-			break;
+int ezd_get_bpp( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-		default :
-			return 0;
+	// Calculate scan width
+	return p->bih.biBitCount;
+}
 
-	} // end switch
+int ezd_get_image_size( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-	return 1;
+	// Calculate scan width
+	return p->bih.biSizeImage;
 }
 
-int ezd_get_pixel( HEZDIMAGE x_hDib, int x, int y )
+
+void* ezd_get_image_ptr( HEZDIMAGE x_hDib )
 {
-	int w, h, sw, pw;
 	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( (void*)0, "Invalid parameters" );
 
-	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !p->pImage )
+	// Calculate scan width
+	return p->pImage;
+}
+
+int ezd_get_stride( HEZDIMAGE x_hDib )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
 		return _ERR( 0, "Invalid parameters" );
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
+	return p->nStride;
+}
 
-	// Ensure pixel is within the image
-	if ( 0 > x || x >= w || 0 > y || y >= h )
-	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, w, h );
-		return 0;
-	} // en dif
+void* ezd_get_row( HEZDIMAGE x_hDib, int y )
+{
+	SImageData *p = (SImageData*)x_hDib;
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !p->pImage )
+		return _ERR( (void*)0, "Invalid parameters" );
 
-	// Pixel and scan width
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 4 );
+	if ( 0 > y || y >= p->nHeight || !EZD_IN_BAND( p, y ) )
+		return _ERR( (void*)0, "Row out of range" );
 
-	// Set the first line
-	switch( p->bih.biBitCount )
-	{
-		case 1 :
-			return p->colPalette[ ( p->pImage[ y * sw + ( x >> 3 ) ] & ( 0x80 >> ( x & 7 ) ) ) ? 1 : 0 ];
+	return EZD_ROW( p, y );
+}
 
-		case 24 :
-		{
-			// Return the color of the specified pixel
-			unsigned char *pImg = &p->pImage[ y * sw + x * pw ];
-			return pImg[ 0 ] | ( pImg[ 1 ] << 8 ) | ( pImg[ 2 ] << 16 );
 
-		} break;
+/// Largest block ezd_save_stream() passes to the write function at once
+#define EZD_WRITE_CHUNK		( 64 * 1024 )
 
-		case 32 :
-			return *(unsigned int*)&p->pImage[ y * sw + x * pw ];
+/// Pixels read back from a set pixel callback per write
+#define EZD_READ_PIXELS		256
 
-	} // end switch
+/// Returns the size of the palette or color masks between the bmp headers and the pixels
+static int ezd_palette_bytes( SImageData *p )
+{
+	if ( EZD_BI_BITFIELDS == p->bih.biCompression )
+		return 3 * sizeof( int );
 
-	return 0;
+	return ezd_palette_size( p ) * sizeof( p->colPalette[ 0 ] );
 }
 
-int ezd_line( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+/// Writes the bmp file headers for an image to pHdr, returns their size
+static int ezd_file_headers( SImageData *p, unsigned char *pHdr )
 {
-	int w, h, sw, pw, xd, yd, xl, yl, done = 0;
-	SImageData *p = (SImageData*)x_hDib;
+	int palette_size = 0;
+	SDIBFileHeader dfh;
+	SBitmapInfoHeader bih;
+	static const unsigned int masks[ 3 ] = { 0xf800, 0x07e0, 0x001f };
 
-	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
-		 || ( !p->pImage && !p->pfSetPixel ) )
-		return _ERR( 0, "Invalid parameters" );
+	// Ensure packing is ok
+	if ( sizeof( SDIBFileHeader ) != 14 )
+		return _ERR( 0, "Structure packing for DIB header is incorrect" );
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
+	// Ensure packing is ok
+	if ( sizeof( SBitmapInfoHeader ) != 40 )
+		return _ERR( 0, "Structure packing for BITMAP header is incorrect" );
 
-	// Determine direction and distance
-	xd = ( x1 < x2 ) ? 1 : -1;
-	yd = ( y1 < y2 ) ? 1 : -1;
-	xl = ( x1 < x2 ) ? ( x2 - x1 ) : ( x1 - x2 );
-	yl = ( y1 < y2 ) ? ( y2 - y1 ) : ( y1 - y2 );
+	bih = p->bih;
 
-	// Check for user callback function
-	if ( p->pfSetPixel )
-	{
-		int mx = 0, my = 0;
+	// Callback images are read back as top down 24 bit
+	if ( !p->pImage )
+	{	bih.biBitCount = 24;
+		bih.biHeight = -p->nHeight;
+		bih.biSizeImage = EZD_IMAGE_SIZE( p->nWidth, p->nHeight, 24, 4 );
+		bih.biCompression = bih.biClrUsed = bih.biClrImportant = 0;
+	} // end if
 
-		// Draw the line
-		while ( !done )
+	// Add palettte size
+	else
+		palette_size = ezd_palette_bytes( p );
+
+	// Fill in header info
+	dfh.uMagicNumber = EZD_MAGIC_NUMBER;
+	dfh.uSize = sizeof( SDIBFileHeader ) + bih.biSize + palette_size + bih.biSizeImage;
+	dfh.uReserved1 = 0;
+	dfh.uReserved2 = 0;
+	dfh.uOffset = sizeof( SDIBFileHeader ) + bih.biSize + palette_size;
+
+	EZD_MEMCPY( (char*)pHdr, (const char*)&dfh, sizeof( dfh ) );
+	EZD_MEMCPY( (char*)&pHdr[ sizeof( dfh ) ], (const char*)&bih, sizeof( bih ) );
+	if ( palette_size )
+		EZD_MEMCPY( (char*)&pHdr[ sizeof( dfh ) + sizeof( bih ) ],
+					( EZD_BI_BITFIELDS == bih.biCompression ) ? (const char*)masks : (const char*)p->pPalette,
+					palette_size );
+
+	return (int)dfh.uOffset;
+}
+
+int ezd_get_file_size( HEZDIMAGE x_hDib )
+{
+	unsigned char hdr[ EZD_FILE_HEADERS ];
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
+
+	if ( !ezd_file_headers( p, hdr ) )
+		return 0;
+
+	return (int)( (SDIBFileHeader*)hdr )->uSize;
+}
+
+const void* ezd_get_file( HEZDIMAGE x_hDib, int *x_pSize )
+{
+	int n;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( (const void*)0, "Invalid parameters" );
+
+	// Only the image's own buffer has room in front of it
+	if ( !( EZD_FLAG_FILE_HEADROOM & p->uFlags ) || !p->pImage
+		 || p->pImage != ezd_own_image( p ) || p->nBandRows )
+		return _ERR( (const void*)0, "Image has no room for the file headers" );
+
+	n = ezd_file_headers( p, p->pImage - EZD_FILE_HEADERS_BPP( p->bih.biBitCount ) );
+	if ( !n )
+		return 0;
+
+	// Slide the headers up against the image if they are shorter
+	if ( EZD_FILE_HEADERS_BPP( p->bih.biBitCount ) != n )
+		EZD_MEMMOVE( (char*)( p->pImage - n ), (const char*)( p->pImage - EZD_FILE_HEADERS_BPP( p->bih.biBitCount ) ), n );
+
+	if ( x_pSize )
+		*x_pSize = n + (int)p->bih.biSizeImage;
+
+	return p->pImage - n;
+}
+
+int ezd_save_stream( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser )
+{
+	int y, n, pos, row;
+	unsigned char hdr[ EZD_FILE_HEADERS ];
+	SImageData *p = (SImageData*)x_hDib;
+
+	// Sanity checks
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !x_pfWrite )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Only one band is in memory while rendering bands
+	if ( p->nBandRows )
+		return _ERR( 0, "Can't save while rendering bands" );
+
+	if ( !p->pImage && !p->pfSetPixel )
+		return _ERR( 0, "No image data or set pixel callback" );
+
+	// Write the headers and palette
+	n = ezd_file_headers( p, hdr );
+	if ( !n || !x_pfWrite( x_pUser, hdr, n ) )
+		return _ERR( 0, "Error writing DIB header" );
+
+	// Write the image data in whole rows
+	if ( p->pImage )
+	{
+		row = ( EZD_WRITE_CHUNK > p->nStride ) ? EZD_WRITE_CHUNK / p->nStride : 1;
+		for ( y = 0; y < p->nHeight; y += row )
+		{	n = ( p->nHeight - y < row ) ? p->nHeight - y : row;
+			if ( !x_pfWrite( x_pUser, EZD_ROW( p, y ), n * p->nStride ) )
+				return _ERR( 0, "Error writing image data" );
+		} // end for
+
+		return 1;
+
+	} // end if
+
+	// Read the callback image back a piece of a row at a time
+	{
+		int x, c;
+		unsigned char buf[ EZD_READ_PIXELS * 3 ];
+
+		for ( y = 0; y < p->nHeight; y++ )
+		{
+			for ( x = 0; x < p->nWidth; x += n )
+			{
+				n = ( p->nWidth - x < EZD_READ_PIXELS ) ? p->nWidth - x : EZD_READ_PIXELS;
+				for ( pos = 0; pos < n; pos++ )
+				{	c = p->pfSetPixel( p->pSetPixelUser, x + pos, y, 0xffffff, -1 );
+					buf[ pos * 3 ] = c & 0xff;
+					buf[ pos * 3 + 1 ] = ( c >> 8 ) & 0xff;
+					buf[ pos * 3 + 2 ] = ( c >> 16 ) & 0xff;
+				} // end for
+
+				if ( !x_pfWrite( x_pUser, buf, n * 3 ) )
+					return _ERR( 0, "Error writing image data" );
+
+			} // end for
+
+			// Pad the row
+			n = EZD_SCANWIDTH( p->nWidth, 24, 4 ) - p->nWidth * 3;
+			if ( n )
+			{	EZD_MEMSET( (char*)buf, 0, n );
+				if ( !x_pfWrite( x_pUser, buf, n ) )
+					return _ERR( 0, "Error writing image data" );
+			} // end if
+
+		} // end for
+
+	}
+
+	return 1;
+}
+
+#if !defined( EZD_NO_FILES )
+
+/// ezd_save_stream() write function for ezd_save()
+static int ezd_write_file( void *pFile, const void *pData, int nData )
+{
+	return nData == (int)fwrite( pData, 1, nData, (FILE*)pFile );
+}
+
+#endif
+
+/// Output buffer for ezd_save_mem()
+typedef struct _SMemWriter
+{
+	/// Next byte to write
+	unsigned char		*pPos;
+
+	/// Bytes left
+	int					nLeft;
+
+} SMemWriter;
+
+/// ezd_save_stream() write function for ezd_save_mem()
+static int ezd_write_mem( void *pMem, const void *pData, int nData )
+{
+	SMemWriter *m = (SMemWriter*)pMem;
+	if ( nData > m->nLeft )
+		return 0;
+
+	EZD_MEMCPY( (char*)m->pPos, (const char*)pData, nData );
+	m->pPos += nData, m->nLeft -= nData;
+
+	return 1;
+}
+
+/// Write function that only counts the bytes
+static int ezd_write_count( void *pCount, const void *pData, int nData )
+{
+	*(int*)pCount += nData;
+	return 1;
+}
+
+int ezd_save_mem( HEZDIMAGE x_hDib, void *x_pBuf, int x_nBuf )
+{
+	int n;
+	SMemWriter m;
+
+	if ( !x_pBuf )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Make sure it all fits before writing anything
+	n = ezd_get_file_size( x_hDib );
+	if ( !n || n > x_nBuf )
+		return _ERR( 0, "Buffer too small" );
+
+	m.pPos = (unsigned char*)x_pBuf, m.nLeft = x_nBuf;
+	if ( !ezd_save_stream( x_hDib, ezd_write_mem, &m ) )
+		return 0;
+
+	return n;
+}
+
+/// Stream save function, ezd_save_stream() or ezd_save_png_stream()
+typedef int (*t_ezd_save)( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser );
+
+/// Saves an image to a file with a stream save function
+static int ezd_save_file( HEZDIMAGE x_hDib, const char *x_pFile, t_ezd_save x_pfSave )
+{
+#if defined( EZD_NO_FILES )
+	return 0;
+#else
+	int ok;
+	FILE *fh;
+
+	// Sanity checks
+	if ( !x_pFile || !*x_pFile || !x_hDib )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Attempt to open the output file
+	fh = fopen ( x_pFile, "wb" );
+	if ( !fh )
+		return _ERR( 0, "Failed to open DIB file for writing" );
+
+	ok = x_pfSave( x_hDib, ezd_write_file, fh );
+
+	// Close the file handle
+	if ( fclose( fh ) )
+		return _ERR( 0, "Error closing DIB file" );
+
+	return ok;
+#endif
+}
+
+int ezd_save( HEZDIMAGE x_hDib, const char *x_pFile )
+{
+	return ezd_save_file( x_hDib, x_pFile, ezd_save_stream );
+}
+
+/// bmp compression types
+#define EZD_BI_RLE8			1
+#define EZD_BI_RLE4			2
+
+/// Color lookup slots for ezd_save_rle_stream(), a power of two
+#define EZD_RLE_HASH		512
+
+#if !defined( EZD_NO_ALLOCATION )
+
+/// Run length encoding state for ezd_save_rle_stream()
+typedef struct _SRleJob
+{
+	/// Image being saved
+	SImageData			*p;
+
+	/// Palette and the number of colors in it
+	int					nColors;
+	int					colPal[ 256 ];
+
+	/// Color lookup, the color and its palette index in each slot
+	int					colHash[ EZD_RLE_HASH ];
+	unsigned char		uHash[ EZD_RLE_HASH ];
+
+	/// Last color looked up and its index
+	int					colLast;
+	int					nLast;
+
+	/// Palette indices for a row, and the row encoded
+	unsigned char		*pIdx;
+	unsigned char		*pOut;
+
+} SRleJob;
+
+/// Returns the palette index of a color, adding it if there's room, or -1 if there isn't
+static int ezd_rle_color( SRleJob *r, int col )
+{
+	unsigned int h;
+
+	// Flat images repeat the same color
+	if ( col == r->colLast )
+		return r->nLast;
+
+	for ( h = ( (unsigned int)col * 2654435761u ) >> 23; ; h = ( h + 1 ) & ( EZD_RLE_HASH - 1 ) )
+	{
+		if ( col == r->colHash[ h ] )
+			break;
+
+		// New color
+		if ( 0 > r->colHash[ h ] )
+		{	if ( 256 <= r->nColors )
+				return -1;
+			r->colHash[ h ] = col, r->uHash[ h ] = (unsigned char)r->nColors;
+			r->colPal[ r->nColors++ ] = col;
+			break;
+		} // end if
+
+	} // end for
+
+	r->colLast = col, r->nLast = r->uHash[ h ];
+
+	return r->nLast;
+}
+
+/// Reads a row as palette indices, returns zero if there are too many colors
+static int ezd_rle_row( SRleJob *r, int y )
+{
+	int x, i, col;
+	const unsigned char *s;
+	SImageData *p = r->p;
+
+	// Compressed bitmaps are always bottom up
+	if ( !p->pImage || 0 > p->bih.biHeight )
+		y = p->nHeight - 1 - y;
+
+	for ( x = 0; !p->pImage && x < p->nWidth; x++ )
+	{	i = ezd_rle_color( r, p->pfSetPixel( p->pSetPixelUser, x, y, 0xffffff, -1 ) & 0xffffff );
+		if ( 0 > i )
+			return 0;
+		r->pIdx[ x ] = (unsigned char)i;
+	} // end for
+
+	if ( !p->pImage )
+		return 1;
+
+	s = EZD_ROW( p, y );
+	for ( x = 0; x < p->nWidth; x++ )
+	{
+		switch ( p->bih.biBitCount )
+		{
+			case 1 :
+				r->pIdx[ x ] = ( s[ x >> 3 ] & ( 0x80 >> ( x & 7 ) ) ) ? 1 : 0;
+				continue;
+
+			case 24 :
+				col = s[ x * 3 ] | ( s[ x * 3 + 1 ] << 8 ) | ( s[ x * 3 + 2 ] << 16 );
+				break;
+
+			case 32 :
+				col = *(const int*)&s[ x * 4 ] & 0xffffff;
+				break;
+
+			default :
+				col = ezd_px_color( p, ezd_get_v( p, s, x ) ) & 0xffffff;
+				break;
+
+		} // end switch
+
+		i = ezd_rle_color( r, col );
+		if ( 0 > i )
+			return 0;
+		r->pIdx[ x ] = (unsigned char)i;
+
+	} // end for
+
+	return 1;
+}
+
+#if defined( EZD_SSE2 )
+
+/// Returns the index of the lowest set bit
+static int ezd_low_bit( unsigned int m )
+{
+	int i;
+	for ( i = 0; !( m & 1 ); i++ )
+		m >>= 1;
+	return i;
+}
+
+#endif
+
+/// Returns the end of the run of bytes the same as p[ i ]
+static int ezd_run_end( const unsigned char *p, int i, int n )
+{
+	int e = i + 1;
+
+#if defined( EZD_SSE2 )
+	int m;
+	__m128i v = _mm_set1_epi8( (char)p[ i ] );
+
+	for ( ; e + 16 <= n; e += 16 )
+	{	m = ~_mm_movemask_epi8( _mm_cmpeq_epi8( _mm_loadu_si128( (const __m128i*)&p[ e ] ), v ) ) & 0xffff;
+		if ( m )
+			return e + ezd_low_bit( m );
+	} // end for
+#endif
+
+	while ( e < n && p[ e ] == p[ i ] )
+		e++;
+
+	return e;
+}
+
+/// Returns where the next run of three or more bytes starts, or n
+static int ezd_run_start( const unsigned char *p, int i, int n )
+{
+#if defined( EZD_SSE2 )
+	int m;
+	__m128i a, b, c;
+
+	for ( ; i + 18 <= n; i += 16 )
+	{	a = _mm_loadu_si128( (const __m128i*)&p[ i ] );
+		b = _mm_loadu_si128( (const __m128i*)&p[ i + 1 ] );
+		c = _mm_loadu_si128( (const __m128i*)&p[ i + 2 ] );
+		m = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi8( a, b ), _mm_cmpeq_epi8( b, c ) ) );
+		if ( m )
+			return i + ezd_low_bit( m );
+	} // end for
+#endif
+
+	for ( ; i + 2 < n; i++ )
+		if ( p[ i ] == p[ i + 1 ] && p[ i ] == p[ i + 2 ] )
+			return i;
+
+	return n;
+}
+
+/// Run length encodes a row of palette indices, returns the encoded size
+/**
+	Runs of three or more are encoded, the pixels in between are
+	written in absolute mode, or as short runs when there are fewer
+	than three.  b4 packs two pixels per byte for BI_RLE4.  pOut
+	needs room for twice as many bytes as pixels.
+*/
+static int ezd_rle_encode( unsigned char *pOut, const unsigned char *p, int n, int b4 )
+{
+	int i = 0, e, k, j;
+	unsigned char *o = pOut;
+
+	while ( i < n )
+	{
+		e = ezd_run_end( p, i, n );
+		if ( 3 <= e - i )
+		{	for ( ; i < e; i += k )
+			{	k = ( 255 < e - i ) ? 255 : e - i;
+				*o++ = (unsigned char)k;
+				*o++ = b4 ? (unsigned char)( ( p[ i ] << 4 ) | p[ i ] ) : p[ i ];
+			} // end for
+			continue;
+		} // end if
+
+		// Pixels up to the next run
+		e = ezd_run_start( p, i, n );
+		k = ( 255 < e - i ) ? 255 : e - i;
+
+		// Absolute mode needs three or more
+		if ( 3 > k )
+		{	if ( b4 )
+				*o++ = (unsigned char)k, *o++ = (unsigned char)( ( p[ i ] << 4 ) | ( ( 2 == k ) ? p[ i + 1 ] : 0 ) );
+			else
+				for ( j = 0; j < k; j++ )
+					*o++ = 1, *o++ = p[ i + j ];
+		} // end if
+
+		// Padded to a word
+		else
+		{	*o++ = 0, *o++ = (unsigned char)k;
+			if ( b4 )
+			{	for ( j = 0; j < k; j += 2 )
+					*o++ = (unsigned char)( ( p[ i + j ] << 4 ) | ( ( j + 1 < k ) ? p[ i + j + 1 ] : 0 ) );
+				if ( ( ( k + 1 ) / 2 ) & 1 )
+					*o++ = 0;
+			} // end if
+			else
+			{	EZD_MEMCPY( (char*)o, (const char*)&p[ i ], k );
+				o += k;
+				if ( k & 1 )
+					*o++ = 0;
+			} // end else
+		} // end else
+
+		i += k;
+
+	} // end while
+
+	return (int)( o - pOut );
+}
+
+#endif
+
+int ezd_save_rle_stream( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	int y, n, ok = 1, size = 0;
+	SRleJob r;
+	SDIBFileHeader dfh;
+	SBitmapInfoHeader bih;
+	SImageData *p = (SImageData*)x_hDib;
+
+	// Sanity checks
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !x_pfWrite )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Only one band is in memory while rendering bands
+	if ( p->nBandRows )
+		return _ERR( 0, "Can't save while rendering bands" );
+
+	if ( !p->pImage && !p->pfSetPixel )
+		return _ERR( 0, "No image data or set pixel callback" );
+
+	// Row of indices, and room for it encoded
+	r.pIdx = (unsigned char*)EZD_malloc( p->nWidth * 3 + 16 );
+	if ( !r.pIdx )
+		return _ERR( 0, "Out of memory" );
+	r.pOut = &r.pIdx[ p->nWidth ];
+
+	// 1 bit images already have a palette
+	r.p = p, r.colLast = -1, r.nLast = 0;
+	EZD_MEMSET( (char*)r.colHash, 0xff, sizeof( r.colHash ) );
+	if ( p->pImage && 1 == p->bih.biBitCount )
+		r.nColors = 2, r.colPal[ 0 ] = p->pPalette[ 0 ], r.colPal[ 1 ] = p->pPalette[ 1 ];
+	else
+		for ( r.nColors = 0, y = 0; ok && y < p->nHeight; y++ )
+			ok = ezd_rle_row( &r, y );
+
+	// Too many colors, write it uncompressed
+	if ( !ok )
+	{	EZD_free( r.pIdx );
+		return ezd_save_stream( x_hDib, x_pfWrite, x_pUser );
+	} // end if
+
+	bih = p->bih;
+	bih.biBitCount = ( 16 >= r.nColors ) ? 4 : 8;
+	bih.biCompression = ( 4 == bih.biBitCount ) ? EZD_BI_RLE4 : EZD_BI_RLE8;
+	bih.biHeight = p->nHeight;
+	bih.biClrUsed = r.nColors, bih.biClrImportant = 0;
+
+	// The headers need the compressed size, each row ends with an end of line or bitmap
+	for ( y = 0; y < p->nHeight; y++ )
+		ezd_rle_row( &r, y ), size += ezd_rle_encode( r.pOut, r.pIdx, p->nWidth, 4 == bih.biBitCount ) + 2;
+	bih.biSizeImage = size;
+
+	dfh.uMagicNumber = EZD_MAGIC_NUMBER;
+	dfh.uOffset = sizeof( SDIBFileHeader ) + sizeof( SBitmapInfoHeader ) + r.nColors * 4;
+	dfh.uSize = dfh.uOffset + size;
+	dfh.uReserved1 = dfh.uReserved2 = 0;
+
+	ok = x_pfWrite( x_pUser, &dfh, sizeof( dfh ) ) && x_pfWrite( x_pUser, &bih, sizeof( bih ) )
+		 && x_pfWrite( x_pUser, r.colPal, r.nColors * 4 );
+
+	for ( y = 0; ok && y < p->nHeight; y++ )
+	{	ezd_rle_row( &r, y );
+		n = ezd_rle_encode( r.pOut, r.pIdx, p->nWidth, 4 == bih.biBitCount );
+		r.pOut[ n++ ] = 0, r.pOut[ n++ ] = ( y < p->nHeight - 1 ) ? 0 : 1;
+		ok = x_pfWrite( x_pUser, r.pOut, n );
+	} // end for
+
+	EZD_free( r.pIdx );
+
+	if ( !ok )
+		return _ERR( 0, "Error writing DIB file" );
+
+	return 1;
+#endif
+}
+
+int ezd_save_rle_mem( HEZDIMAGE x_hDib, void *x_pBuf, int x_nBuf )
+{
+	int n = 0;
+	SMemWriter m;
+
+	// Without a buffer, just return the size
+	if ( !x_pBuf )
+		return ezd_save_rle_stream( x_hDib, ezd_write_count, &n ) ? n : 0;
+
+	m.pPos = (unsigned char*)x_pBuf, m.nLeft = x_nBuf;
+	if ( !ezd_save_rle_stream( x_hDib, ezd_write_mem, &m ) )
+		return 0;
+
+	return x_nBuf - m.nLeft;
+}
+
+int ezd_save_rle( HEZDIMAGE x_hDib, const char *x_pFile )
+{
+	return ezd_save_file( x_hDib, x_pFile, ezd_save_rle_stream );
+}
+
+HEZDIMAGE ezd_open_mapped( const char *x_pFile, unsigned int x_uFlags )
+{
+#if defined( EZD_NO_MMAP )
+	return 0;
+#else
+	int n;
+	size_t nSize = 0;
+	long long nImageSize = 0;
+	unsigned int uMasks[ 3 ], uFlags = EZD_FLAG_USER_IMAGE_BUFFER | EZD_FLAG_MAPPED;
+	unsigned char *pBase;
+	SDIBFileHeader dfh;
+	SBitmapInfoHeader bih;
+	SMapInfo *m;
+	SImageData *p;
+
+	if ( !x_pFile || !*x_pFile || ( ~( EZD_MAP_COPY | EZD_MAP_WRITE ) & x_uFlags ) )
+		return _ERR( (HEZDIMAGE)0, "Invalid parameters" );
+
+	pBase = ezd_map_file( x_pFile, x_uFlags, 0, &nSize );
+	if ( !pBase )
+		return _ERR( (HEZDIMAGE)0, "Failed to map DIB file" );
+
+	// The headers aren't aligned in the file
+	dfh.uMagicNumber = 0;
+	if ( sizeof( dfh ) + sizeof( bih ) <= nSize )
+	{	EZD_MEMCPY( (char*)&dfh, (const char*)pBase, sizeof( dfh ) );
+		EZD_MEMCPY( (char*)&bih, (const char*)&pBase[ sizeof( dfh ) ], sizeof( bih ) );
+		nImageSize = ( ( (long long)bih.biWidth * bih.biBitCount + 31 ) / 32 ) * 4
+					 * EZD_ABS( (long long)bih.biHeight );
+
+		// 16 bit files are 5-5-5, unless their color masks say 5-6-5
+		if ( 16 == bih.biBitCount && EZD_BI_BITFIELDS == bih.biCompression
+			 && sizeof( dfh ) + sizeof( bih ) + sizeof( uMasks ) <= nSize )
+		{	EZD_MEMCPY( (char*)uMasks, (const char*)&pBase[ sizeof( dfh ) + sizeof( bih ) ], sizeof( uMasks ) );
+			if ( 0xf800 == uMasks[ 0 ] && 0x07e0 == uMasks[ 1 ] && 0x001f == uMasks[ 2 ] )
+				bih.biCompression = 0;
+			else if ( 0x7c00 == uMasks[ 0 ] && 0x03e0 == uMasks[ 1 ] && 0x001f == uMasks[ 2 ] )
+				bih.biCompression = 0, uFlags |= EZD_FLAG_RGB555;
+		} // end if
+		else if ( 16 == bih.biBitCount )
+			uFlags |= EZD_FLAG_RGB555;
+
+	} // end if
+
+	// Only uncompressed images that are all there
+	if ( EZD_MAGIC_NUMBER != dfh.uMagicNumber || sizeof( SBitmapInfoHeader ) != bih.biSize
+		 || 1 != bih.biPlanes || 0 != bih.biCompression || !EZD_VALID_BPP( bih.biBitCount )
+		 || 0 >= bih.biWidth || !bih.biHeight || 0x7fffffff < nImageSize
+		 || sizeof( dfh ) + sizeof( bih ) > dfh.uOffset || dfh.uOffset > nSize
+		 || (size_t)nImageSize > nSize - dfh.uOffset )
+	{	ezd_unmap_file( pBase, nSize );
+		return _ERR( (HEZDIMAGE)0, "Unsupported DIB file" );
+	} // end if
+
+	// Header and row table, with the mapping where the image would go
+	p = ezd_create_image( bih.biWidth, bih.biHeight, bih.biBitCount, uFlags );
+	if ( !p )
+	{	ezd_unmap_file( pBase, nSize );
+		return 0;
+	} // end if
+
+	m = EZD_MAP_INFO( p );
+	m->pBase = pBase, m->nSize = nSize, m->pPixels = &pBase[ dfh.uOffset ];
+	m->nShared = ( EZD_MAP_WRITE & x_uFlags ) ? 1 : 0;
+
+	// Draw straight on the file's pixels, unless they are read only
+	p->uFlags &= ~EZD_FLAG_USER_IMAGE_BUFFER;
+	if ( !( ( EZD_MAP_COPY | EZD_MAP_WRITE ) & x_uFlags ) )
+		p->uFlags |= EZD_FLAG_READ_ONLY;
+	p->pImage = m->pPixels;
+	ezd_update_rows( p );
+
+	// Palette, the file may have fewer colors than the pixels can index
+	n = ezd_palette_size( p );
+	if ( bih.biClrUsed && (int)bih.biClrUsed < n )
+		n = (int)bih.biClrUsed;
+	if ( 0 < n && sizeof( dfh ) + sizeof( bih ) + n * sizeof( p->colPalette[ 0 ] ) <= dfh.uOffset )
+	{	EZD_MEMCPY( (char*)p->pPalette, (const char*)&pBase[ sizeof( dfh ) + sizeof( bih ) ],
+					n * sizeof( p->colPalette[ 0 ] ) );
+
+		// Drawing only uses the file's colors, and ezd_sync() only writes them
+		if ( 1 != p->bih.biBitCount )
+			p->bih.biClrUsed = n;
+
+	} // end if
+
+	return (HEZDIMAGE)p;
+#endif
+}
+
+HEZDIMAGE ezd_create_mapped( const char *x_pFile, int x_lWidth, int x_lHeight, int x_lBpp )
+{
+#if defined( EZD_NO_MMAP )
+	return 0;
+#else
+	int nOffset, nHdr;
+	unsigned char *pBase, hdr[ EZD_FILE_HEADERS ];
+	SDIBFileHeader *dfh = (SDIBFileHeader*)hdr;
+	SMapInfo *m;
+	SImageData *p;
+
+	if ( !x_pFile || !*x_pFile )
+		return _ERR( (HEZDIMAGE)0, "Invalid parameters" );
+
+	if ( !EZD_VALID_BPP( x_lBpp ) )
+		return _ERR( (HEZDIMAGE)0, "Invalid bits per pixel" );
+
+	// Header and row table, with the mapping where the image would go
+	p = ezd_create_image( x_lWidth, x_lHeight, x_lBpp, EZD_FLAG_USER_IMAGE_BUFFER | EZD_FLAG_MAPPED );
+	if ( !p )
+		return 0;
+
+	m = EZD_MAP_INFO( p );
+	m->pBase = 0;
+
+	// Start the pixels on an aligned offset after the headers
+	nOffset = (int)EZD_ALIGN( sizeof( SDIBFileHeader ) + sizeof( SBitmapInfoHeader ) + ezd_palette_bytes( p ), 16 );
+
+	pBase = ezd_map_file( x_pFile, EZD_MAP_WRITE, nOffset + (size_t)p->bih.biSizeImage, &m->nSize );
+	if ( !pBase )
+	{	ezd_destroy( (HEZDIMAGE)p );
+		return _ERR( (HEZDIMAGE)0, "Failed to create DIB file" );
+	} // end if
+
+	m->pBase = pBase, m->pPixels = &pBase[ nOffset ], m->nShared = 1;
+
+	// Draw straight into the file
+	p->uFlags &= ~EZD_FLAG_USER_IMAGE_BUFFER;
+	p->pImage = m->pPixels;
+	ezd_update_rows( p );
+
+	// Write the headers
+	nHdr = ezd_file_headers( p, hdr );
+	dfh->uOffset = nOffset;
+	dfh->uSize = nOffset + p->bih.biSizeImage;
+	EZD_MEMCPY( (char*)pBase, (const char*)hdr, nHdr );
+
+	return (HEZDIMAGE)p;
+#endif
+}
+
+int ezd_sync( HEZDIMAGE x_hDib )
+{
+#if defined( EZD_NO_MMAP )
+	return 0;
+#else
+	int n;
+	SMapInfo *m;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
+
+	if ( !( EZD_FLAG_MAPPED & p->uFlags ) || !EZD_MAP_INFO( p )->nShared )
+		return _ERR( 0, "Image is not mapped to a file for writing" );
+
+	m = EZD_MAP_INFO( p );
+
+	// The palette may have changed
+	n = ezd_palette_size( p ) * (int)sizeof( p->colPalette[ 0 ] );
+	if ( n && m->pPixels - m->pBase >= (int)( sizeof( SDIBFileHeader ) + sizeof( SBitmapInfoHeader ) ) + n )
+		EZD_MEMCPY( (char*)&m->pBase[ sizeof( SDIBFileHeader ) + sizeof( SBitmapInfoHeader ) ],
+					(const char*)p->pPalette, n );
+
+#	if defined( _WIN32 )
+	return FlushViewOfFile( m->pBase, 0 ) ? 1 : _ERR( 0, "Error writing DIB file" );
+#	else
+	return msync( m->pBase, m->nSize, MS_SYNC ) ? _ERR( 0, "Error writing DIB file" ) : 1;
+#	endif
+#endif
+}
+
+//------------------------------------------------------------------
+// Fill kernels
+//------------------------------------------------------------------
+
+/// Size of one repeat of a fill pattern, multiple of 1, 3, 4 and 32
+#define EZD_PATTERN_PERIOD	96
+
+/// Fills a buffer with a repeating pattern
+/**
+	\param [in] pDst	- Buffer to fill
+	\param [in] nBytes	- Number of bytes to write
+	\param [in] pPat	- Two periods of the pattern, see ezd_make_pattern()
+	\param [in] bStream	- Non-zero to use non-temporal stores
+*/
+typedef void (*t_ezd_fill_pattern)( unsigned char *pDst, int nBytes, const unsigned char *pPat, int bStream );
+
+/// Replicates the pixel in pPix into a pattern buffer
+static void ezd_make_pattern( unsigned char *pPat, const unsigned char *pPix, int pw )
+{
+	int i;
+	for ( i = 0; i < EZD_PATTERN_PERIOD * 2; i++ )
+		pPat[ i ] = pPix[ i % pw ];
+}
+
+#if !defined( EZD_SSE2 )
+
+static void ezd_fill_pattern_c( unsigned char *pDst, int nBytes, const unsigned char *pPat, int bStream )
+{
+	// Copy whole periods
+	while ( EZD_PATTERN_PERIOD <= nBytes )
+	{	EZD_MEMCPY( pDst, pPat, EZD_PATTERN_PERIOD );
+		pDst += EZD_PATTERN_PERIOD, nBytes -= EZD_PATTERN_PERIOD;
+	} // end while
+
+	// Partial period
+	if ( 0 < nBytes )
+		EZD_MEMCPY( pDst, pPat, nBytes );
+}
+
+#endif
+
+#if defined( EZD_SSE2 )
+
+static void ezd_fill_pattern_sse2( unsigned char *pDst, int nBytes, const unsigned char *pPat, int bStream )
+{
+	__m128i v0, v1, v2;
+
+	// Bytes until the destination is aligned
+	int n = (int)( ( 16 - ( (size_t)pDst & 15 ) ) & 15 );
+	if ( n > nBytes )
+		n = nBytes;
+
+	// Align the destination
+	EZD_MEMCPY( pDst, pPat, n );
+	pDst += n, nBytes -= n;
+
+	// Three vectors hold the pattern at the current phase
+	v0 = _mm_loadu_si128( (const __m128i*)&pPat[ n ] );
+	v1 = _mm_loadu_si128( (const __m128i*)&pPat[ n + 16 ] );
+	v2 = _mm_loadu_si128( (const __m128i*)&pPat[ n + 32 ] );
+
+	if ( bStream )
+	{
+		while ( 48 <= nBytes )
+		{	_mm_stream_si128( (__m128i*)pDst, v0 );
+			_mm_stream_si128( (__m128i*)( pDst + 16 ), v1 );
+			_mm_stream_si128( (__m128i*)( pDst + 32 ), v2 );
+			pDst += 48, nBytes -= 48;
+		} // end while
+
+		_mm_sfence();
+
+	} // end if
+
+	else
+		while ( 48 <= nBytes )
+		{	_mm_store_si128( (__m128i*)pDst, v0 );
+			_mm_store_si128( (__m128i*)( pDst + 16 ), v1 );
+			_mm_store_si128( (__m128i*)( pDst + 32 ), v2 );
+			pDst += 48, nBytes -= 48;
+		} // end while
+
+	// Remaining bytes
+	if ( 0 < nBytes )
+		EZD_MEMCPY( pDst, &pPat[ n ], nBytes );
+}
+
+#endif
+
+#if defined( EZD_AVX2 )
+
+static EZD_TARGET_AVX2 void ezd_fill_pattern_avx2( unsigned char *pDst, int nBytes, const unsigned char *pPat, int bStream )
+{
+	__m256i v0, v1, v2;
+
+	// Bytes until the destination is aligned
+	int n = (int)( ( 32 - ( (size_t)pDst & 31 ) ) & 31 );
+	if ( n > nBytes )
+		n = nBytes;
+
+	// Align the destination
+	EZD_MEMCPY( pDst, pPat, n );
+	pDst += n, nBytes -= n;
+
+	// Three vectors hold the pattern at the current phase
+	v0 = _mm256_loadu_si256( (const __m256i*)&pPat[ n ] );
+	v1 = _mm256_loadu_si256( (const __m256i*)&pPat[ n + 32 ] );
+	v2 = _mm256_loadu_si256( (const __m256i*)&pPat[ n + 64 ] );
+
+	if ( bStream )
+	{
+		while ( 96 <= nBytes )
+		{	_mm256_stream_si256( (__m256i*)pDst, v0 );
+			_mm256_stream_si256( (__m256i*)( pDst + 32 ), v1 );
+			_mm256_stream_si256( (__m256i*)( pDst + 64 ), v2 );
+			pDst += 96, nBytes -= 96;
+		} // end while
+
+		_mm_sfence();
+
+	} // end if
+
+	else
+		while ( 96 <= nBytes )
+		{	_mm256_store_si256( (__m256i*)pDst, v0 );
+			_mm256_store_si256( (__m256i*)( pDst + 32 ), v1 );
+			_mm256_store_si256( (__m256i*)( pDst + 64 ), v2 );
+			pDst += 96, nBytes -= 96;
+		} // end while
+
+	// Remaining bytes
+	if ( 0 < nBytes )
+		EZD_MEMCPY( pDst, &pPat[ n ], nBytes );
+
+	_mm256_zeroupper();
+}
+
+/// Returns non-zero if the processor and os support AVX2
+static int ezd_cpu_has_avx2()
+{
+#if defined( _MSC_VER )
+	int r[ 4 ];
+	__cpuid( r, 0 );
+	if ( 7 > r[ 0 ] )
+		return 0;
+
+	// OSXSAVE and AVX
+	__cpuid( r, 1 );
+	if ( ( r[ 2 ] & 0x18000000 ) != 0x18000000 )
+		return 0;
+
+	// Are the ymm registers saved by the os?
+	if ( ( _xgetbv( 0 ) & 6 ) != 6 )
+		return 0;
+
+	__cpuidex( r, 7, 0 );
+	return ( r[ 1 ] & 0x20 ) ? 1 : 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports( "avx2" ) ? 1 : 0;
+#endif
+}
+
+#endif
+
+/// Returns the fastest pattern fill for this processor
+static t_ezd_fill_pattern ezd_get_fill_pattern()
+{
+	static t_ezd_fill_pattern pf = 0;
+
+	if ( pf )
+		return pf;
+
+#if defined( EZD_AVX2 )
+	if ( ezd_cpu_has_avx2() )
+		return pf = ezd_fill_pattern_avx2;
+#endif
+
+#if defined( EZD_SSE2 )
+	return pf = ezd_fill_pattern_sse2;
+#else
+	return pf = ezd_fill_pattern_c;
+#endif
+}
+
+//------------------------------------------------------------------
+// Blend kernels
+//------------------------------------------------------------------
+
+/// Composites a color over n 32 bit pixels
+/**
+	\param [in] pDst	- First pixel
+	\param [in] n		- Number of pixels
+	\param [in] col		- Color, alpha in the top byte
+	\param [in] pm		- Non-zero if col is premultiplied
+*/
+typedef void (*t_ezd_blend_fill)( unsigned char *pDst, int n, int col, int pm );
+
+/// Composites n 32 bit pixels over n pixels using the source alpha
+/**
+	\param [in] pDst	- First destination pixel
+	\param [in] pSrc	- First source pixel, must not overlap pDst
+	\param [in] n		- Number of pixels
+	\param [in] pm		- Non-zero if the source is premultiplied
+*/
+typedef void (*t_ezd_blend_copy)( unsigned char *pDst, const unsigned char *pSrc, int n, int pm );
+
+/// Calculates the constant part of a blend for each byte of col
+/**
+	Each byte becomes ( k + d * ( 255 - a ) + 128 ) / 255, where
+	k is s * a with an opaque source alpha, or s * 255 if
+	premultiplied.  Dividing by 255 is exact as ( t + ( t >> 8 ) ) >> 8,
+	and every term fits in 16 bits.
+
+	\return 255 - alpha
+*/
+static int ezd_blend_setup( int col, int pm, unsigned short *pK )
+{
+	int i, s, a = ( col >> 24 ) & 0xff;
+
+	for ( i = 0; i < 4; i++ )
+	{	s = ( col >> ( i * 8 ) ) & 0xff;
+		if ( pm )
+			pK[ i ] = (unsigned short)( ( s < a ? s : a ) * 255 + 128 );
+		else
+			pK[ i ] = (unsigned short)( ( 3 == i ? 255 : s ) * a + 128 );
+	} // end for
+
+	return 255 - a;
+}
+
+static void ezd_blend_fill_c( unsigned char *pDst, int n, int col, int pm )
+{
+	int i, t, ia;
+	unsigned short k[ 4 ];
+
+	ia = ezd_blend_setup( col, pm, k );
+	for ( ; 0 < n; n--, pDst += 4 )
+		for ( i = 0; i < 4; i++ )
+		{	t = k[ i ] + pDst[ i ] * ia;
+			pDst[ i ] = (unsigned char)( ( t + ( t >> 8 ) ) >> 8 );
+		} // end for
+}
+
+static void ezd_blend_copy_c( unsigned char *pDst, const unsigned char *pSrc, int n, int pm )
+{
+	unsigned int c;
+
+	for ( ; 0 < n; n--, pDst += 4, pSrc += 4 )
+	{
+		c = *(const unsigned int*)pSrc;
+
+		// Opaque and transparent pixels
+		if ( 0xff000000 == ( c & 0xff000000 ) )
+			*(unsigned int*)pDst = c;
+		else if ( pm ? c : ( c & 0xff000000 ) )
+			ezd_blend_fill_c( pDst, 1, (int)c, pm );
+
+	} // end for
+}
+
+#if defined( EZD_SSE2 )
+
+/// Blends eight 16 bit channels, ( k + d * ia + 128 ) / 255
+#define EZD_BLEND_16( d, k, ia ) \
+	( d = _mm_add_epi16( _mm_mullo_epi16( d, ia ), k ), \
+	  d = _mm_srli_epi16( _mm_add_epi16( d, _mm_srli_epi16( d, 8 ) ), 8 ) )
+
+static void ezd_blend_fill_sse2( unsigned char *pDst, int n, int col, int pm )
+{
+	unsigned short k[ 4 ];
+	__m128i vk, via, z = _mm_setzero_si128(), d, lo, hi;
+
+	via = _mm_set1_epi16( (short)ezd_blend_setup( col, pm, k ) );
+	vk = _mm_set_epi16( k[ 3 ], k[ 2 ], k[ 1 ], k[ 0 ], k[ 3 ], k[ 2 ], k[ 1 ], k[ 0 ] );
+
+	// Four pixels at a time
+	for ( ; 4 <= n; n -= 4, pDst += 16 )
+	{	d = _mm_loadu_si128( (const __m128i*)pDst );
+		lo = _mm_unpacklo_epi8( d, z ), hi = _mm_unpackhi_epi8( d, z );
+		EZD_BLEND_16( lo, vk, via ), EZD_BLEND_16( hi, vk, via );
+		_mm_storeu_si128( (__m128i*)pDst, _mm_packus_epi16( lo, hi ) );
+	} // end for
+
+	if ( n )
+		ezd_blend_fill_c( pDst, n, col, pm );
+}
+
+static void ezd_blend_copy_sse2( unsigned char *pDst, const unsigned char *pSrc, int n, int pm )
+{
+	__m128i z = _mm_setzero_si128(), c128 = _mm_set1_epi16( 128 ), c255 = _mm_set1_epi16( 255 );
+	__m128i am = _mm_set_epi16( 255, 0, 0, 0, 255, 0, 0, 0 ), opaque = _mm_set1_epi32( 0xff );
+	__m128i s, d, sl, sh, al, ah, dl, dh;
+
+	for ( ; 4 <= n; n -= 4, pDst += 16, pSrc += 16 )
+	{
+		s = _mm_loadu_si128( (const __m128i*)pSrc );
+
+		// Skip the math if all four pixels are opaque or transparent
+		if ( 0xffff == _mm_movemask_epi8( _mm_cmpeq_epi32( _mm_srli_epi32( s, 24 ), opaque ) ) )
+		{	_mm_storeu_si128( (__m128i*)pDst, s );
+			continue;
+		} // end if
+		if ( 0xffff == _mm_movemask_epi8( _mm_cmpeq_epi32( pm ? s : _mm_srli_epi32( s, 24 ), z ) ) )
+			continue;
+
+		// Spread each pixel's alpha over its channels
+		sl = _mm_unpacklo_epi8( s, z ), sh = _mm_unpackhi_epi8( s, z );
+		al = _mm_shufflehi_epi16( _mm_shufflelo_epi16( sl, 0xff ), 0xff );
+		ah = _mm_shufflehi_epi16( _mm_shufflelo_epi16( sh, 0xff ), 0xff );
+
+		// Constant terms, s * 255 or s * a with an opaque alpha
+		if ( pm )
+			sl = _mm_mullo_epi16( _mm_min_epi16( sl, al ), c255 ),
+			sh = _mm_mullo_epi16( _mm_min_epi16( sh, ah ), c255 );
+		else
+			sl = _mm_mullo_epi16( _mm_or_si128( sl, am ), al ),
+			sh = _mm_mullo_epi16( _mm_or_si128( sh, am ), ah );
+		sl = _mm_add_epi16( sl, c128 ), sh = _mm_add_epi16( sh, c128 );
+
+		d = _mm_loadu_si128( (const __m128i*)pDst );
+		dl = _mm_unpacklo_epi8( d, z ), dh = _mm_unpackhi_epi8( d, z );
+		al = _mm_sub_epi16( c255, al ), ah = _mm_sub_epi16( c255, ah );
+		EZD_BLEND_16( dl, sl, al ), EZD_BLEND_16( dh, sh, ah );
+		_mm_storeu_si128( (__m128i*)pDst, _mm_packus_epi16( dl, dh ) );
+
+	} // end for
+
+	if ( n )
+		ezd_blend_copy_c( pDst, pSrc, n, pm );
+}
+
+#endif
+
+#if defined( EZD_AVX2 )
+
+/// Blends sixteen 16 bit channels, ( k + d * ia + 128 ) / 255
+#define EZD_BLEND_16_AVX2( d, k, ia ) \
+	( d = _mm256_add_epi16( _mm256_mullo_epi16( d, ia ), k ), \
+	  d = _mm256_srli_epi16( _mm256_add_epi16( d, _mm256_srli_epi16( d, 8 ) ), 8 ) )
+
+static EZD_TARGET_AVX2 void ezd_blend_fill_avx2( unsigned char *pDst, int n, int col, int pm )
+{
+	unsigned short k[ 4 ];
+	__m256i vk, via, z = _mm256_setzero_si256(), d, lo, hi;
+
+	// Unpacking works within each 128 bit lane, so the constants repeat per lane
+	via = _mm256_set1_epi16( (short)ezd_blend_setup( col, pm, k ) );
+	vk = _mm256_broadcastsi128_si256( _mm_set_epi16( k[ 3 ], k[ 2 ], k[ 1 ], k[ 0 ], k[ 3 ], k[ 2 ], k[ 1 ], k[ 0 ] ) );
+
+	// Eight pixels at a time
+	for ( ; 8 <= n; n -= 8, pDst += 32 )
+	{	d = _mm256_loadu_si256( (const __m256i*)pDst );
+		lo = _mm256_unpacklo_epi8( d, z ), hi = _mm256_unpackhi_epi8( d, z );
+		EZD_BLEND_16_AVX2( lo, vk, via ), EZD_BLEND_16_AVX2( hi, vk, via );
+		_mm256_storeu_si256( (__m256i*)pDst, _mm256_packus_epi16( lo, hi ) );
+	} // end for
+
+	_mm256_zeroupper();
+
+	if ( n )
+		ezd_blend_fill_sse2( pDst, n, col, pm );
+}
+
+static EZD_TARGET_AVX2 void ezd_blend_copy_avx2( unsigned char *pDst, const unsigned char *pSrc, int n, int pm )
+{
+	__m256i z = _mm256_setzero_si256(), c128 = _mm256_set1_epi16( 128 ), c255 = _mm256_set1_epi16( 255 );
+	__m256i am = _mm256_set_epi16( 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0 );
+	__m256i opaque = _mm256_set1_epi32( 0xff ), s, d, sl, sh, al, ah, dl, dh;
+
+	for ( ; 8 <= n; n -= 8, pDst += 32, pSrc += 32 )
+	{
+		s = _mm256_loadu_si256( (const __m256i*)pSrc );
+
+		// Skip the math if all eight pixels are opaque or transparent
+		if ( -1 == _mm256_movemask_epi8( _mm256_cmpeq_epi32( _mm256_srli_epi32( s, 24 ), opaque ) ) )
+		{	_mm256_storeu_si256( (__m256i*)pDst, s );
+			continue;
+		} // end if
+		if ( -1 == _mm256_movemask_epi8( _mm256_cmpeq_epi32( pm ? s : _mm256_srli_epi32( s, 24 ), z ) ) )
+			continue;
+
+		// Spread each pixel's alpha over its channels
+		sl = _mm256_unpacklo_epi8( s, z ), sh = _mm256_unpackhi_epi8( s, z );
+		al = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( sl, 0xff ), 0xff );
+		ah = _mm256_shufflehi_epi16( _mm256_shufflelo_epi16( sh, 0xff ), 0xff );
+
+		// Constant terms, s * 255 or s * a with an opaque alpha
+		if ( pm )
+			sl = _mm256_mullo_epi16( _mm256_min_epi16( sl, al ), c255 ),
+			sh = _mm256_mullo_epi16( _mm256_min_epi16( sh, ah ), c255 );
+		else
+			sl = _mm256_mullo_epi16( _mm256_or_si256( sl, am ), al ),
+			sh = _mm256_mullo_epi16( _mm256_or_si256( sh, am ), ah );
+		sl = _mm256_add_epi16( sl, c128 ), sh = _mm256_add_epi16( sh, c128 );
+
+		d = _mm256_loadu_si256( (const __m256i*)pDst );
+		dl = _mm256_unpacklo_epi8( d, z ), dh = _mm256_unpackhi_epi8( d, z );
+		al = _mm256_sub_epi16( c255, al ), ah = _mm256_sub_epi16( c255, ah );
+		EZD_BLEND_16_AVX2( dl, sl, al ), EZD_BLEND_16_AVX2( dh, sh, ah );
+		_mm256_storeu_si256( (__m256i*)pDst, _mm256_packus_epi16( dl, dh ) );
+
+	} // end for
+
+	_mm256_zeroupper();
+
+	if ( n )
+		ezd_blend_copy_sse2( pDst, pSrc, n, pm );
+}
+
+#endif
+
+/// Returns the fastest color blend for this processor
+static t_ezd_blend_fill ezd_get_blend_fill()
+{
+	static t_ezd_blend_fill pf = 0;
+
+	if ( pf )
+		return pf;
+
+#if defined( EZD_AVX2 )
+	if ( ezd_cpu_has_avx2() )
+		return pf = ezd_blend_fill_avx2;
+#endif
+
+#if defined( EZD_SSE2 )
+	return pf = ezd_blend_fill_sse2;
+#else
+	return pf = ezd_blend_fill_c;
+#endif
+}
+
+/// Returns the fastest pixel blend for this processor
+static t_ezd_blend_copy ezd_get_blend_copy()
+{
+	static t_ezd_blend_copy pf = 0;
+
+	if ( pf )
+		return pf;
+
+#if defined( EZD_AVX2 )
+	if ( ezd_cpu_has_avx2() )
+		return pf = ezd_blend_copy_avx2;
+#endif
+
+#if defined( EZD_SSE2 )
+	return pf = ezd_blend_copy_sse2;
+#else
+	return pf = ezd_blend_copy_c;
+#endif
+}
+
+/// Non-zero if col has to be blended into the image rather than written
+#define EZD_BLENDS( p, col ) ( (p)->nAlpha && 0xff != ( ( (col) >> 24 ) & 0xff ) )
+
+/// Composites col over n pixels of a 32 bit image, see EZD_BLENDS()
+static void ezd_blend_span( SImageData *p, unsigned char *pDst, int n, int col )
+{
+	int pm = EZD_ALPHA_PREMULTIPLIED == p->nAlpha;
+
+	// Transparent colors change nothing
+	if ( !( col & 0xff000000 ) && ( !pm || !col ) )
+		return;
+
+	if ( 4 > n )
+		ezd_blend_fill_c( pDst, n, col, pm );
+	else
+		ezd_get_blend_fill()( pDst, n, col, pm );
+}
+
+//------------------------------------------------------------------
+// 1 bit span engine
+//------------------------------------------------------------------
+
+/// Sets ( c != 0 ) or clears a run of len bits starting at x in a 1 bit image line
+static void ezd_span_1( unsigned char *pLine, int x, int len, int c )
+{
+	unsigned long long v;
+	unsigned char m, *pPos = &pLine[ x >> 3 ];
+	int o = x & 7;
+
+	if ( 0 >= len )
+		return;
+
+	// Does the run fit in a single byte?
+	if ( 8 >= o + len )
+	{	m = (unsigned char)( ( 0xff >> o ) & ( 0xff << ( 8 - o - len ) ) );
+		if ( c ) *pPos |= m; else *pPos &= ~m;
+		return;
+	} // end if
+
+	// Leading mask
+	if ( o )
+	{	m = (unsigned char)( 0xff >> o );
+		if ( c ) *pPos |= m; else *pPos &= ~m;
+		pPos++, len -= 8 - o;
+	} // end if
+
+	// Full words
+	v = c ? ~(unsigned long long)0 : 0;
+	while ( 64 <= len )
+	{	EZD_MEMCPY( pPos, &v, sizeof( v ) );
+		pPos += sizeof( v ), len -= 64;
+	} // end while
+
+	// Full bytes
+	while ( 8 <= len )
+		*pPos++ = (unsigned char)v, len -= 8;
+
+	// Trailing mask
+	if ( len )
+	{	m = (unsigned char)( 0xff << ( 8 - len ) );
+		if ( c ) *pPos |= m; else *pPos &= ~m;
+	} // end if
+}
+
+/// Returns n bits ( n <= 56 ) starting at bit pos, aligned to the top of the word
+static unsigned long long ezd_get_bits( const unsigned char *pBits, int pos, int n )
+{
+	int i, o = pos & 7, nb = ( ( pos & 7 ) + n + 7 ) >> 3;
+	unsigned long long v = 0;
+
+	// Only read the bytes we need
+	pBits += pos >> 3;
+	for ( i = 0; i < nb; i++ )
+		v |= (unsigned long long)pBits[ i ] << ( 56 - i * 8 );
+
+	return ( v << o ) & ~( ~(unsigned long long)0 >> n );
+}
+
+/// ORs ( c != 0 ) or clears the top n bits of v ( n <= 56 ) into a 1 bit image line at x
+static void ezd_bits_1( unsigned char *pLine, int x, unsigned long long v, int n, int c )
+{
+	int i, nb;
+	unsigned char b, *pPos = &pLine[ x >> 3 ];
+
+	// Drop unused bits and shift into position
+	v &= ~( ~(unsigned long long)0 >> n );
+	v >>= x & 7;
+
+	// Only touch the bytes we cover
+	nb = ( ( x & 7 ) + n + 7 ) >> 3;
+	for ( i = 0; i < nb; i++ )
+		if ( 0 != ( b = (unsigned char)( v >> ( 56 - i * 8 ) ) ) )
+		{	if ( c ) pPos[ i ] |= b; else pPos[ i ] &= ~b; }
+}
+
+//------------------------------------------------------------------
+// Runs
+//------------------------------------------------------------------
+
+/// Fills a run of len pixels starting at x in a 16, 24 or 32 bit image line
+static void ezd_span_px( unsigned char *pLine, int x, int len, int pw, int col )
+{
+	unsigned char *pPos = &pLine[ x * pw ];
+
+	// Long runs use the fill kernels
+	if ( 32 <= len )
+	{	unsigned char pix[ 4 ], pat[ EZD_PATTERN_PERIOD * 2 ];
+		pix[ 0 ] = col & 0xff, pix[ 1 ] = ( col >> 8 ) & 0xff;
+		pix[ 2 ] = ( col >> 16 ) & 0xff, pix[ 3 ] = ( col >> 24 ) & 0xff;
+		ezd_make_pattern( pat, pix, pw );
+		ezd_get_fill_pattern()( pPos, len * pw, pat, 0 );
+		return;
+	} // end if
+
+	if ( 4 == pw )
+		for ( ; 0 < len; len--, pPos += 4 )
+			*(unsigned int*)pPos = col;
+
+	else if ( 2 == pw )
+		for ( ; 0 < len; len--, pPos += 2 )
+			pPos[ 0 ] = col & 0xff, pPos[ 1 ] = ( col >> 8 ) & 0xff;
+
+	else
+	{	unsigned char r = col & 0xff;
+		unsigned char g = ( col >> 8 ) & 0xff;
+		unsigned char b = ( col >> 16 ) & 0xff;
+		for ( ; 0 < len; len--, pPos += 3 )
+			pPos[ 0 ] = r, pPos[ 1 ] = g, pPos[ 2 ] = b;
+	} // end else
+}
+
+/// Fills a run of len pixels starting at x with the value v in a 4, 8 or 16 bit image line
+static void ezd_span_v( SImageData *p, unsigned char *pLine, int x, int len, unsigned int v )
+{
+	if ( 0 >= len )
+		return;
+
+	switch( p->bih.biBitCount )
+	{
+		case 4 :
+			// Odd pixels are the low nibble
+			if ( x & 1 )
+				pLine[ x >> 1 ] = (unsigned char)( ( pLine[ x >> 1 ] & 0xf0 ) | v ), x++, len--;
+			EZD_MEMSET( (char*)&pLine[ x >> 1 ], (int)( v | ( v << 4 ) ), len >> 1 );
+			if ( len & 1 )
+				x += len - 1, pLine[ x >> 1 ] = (unsigned char)( ( pLine[ x >> 1 ] & 0x0f ) | ( v << 4 ) );
+			break;
+
+		case 8 :
+			if ( 1 == len )
+				pLine[ x ] = (unsigned char)v;
+			else
+				EZD_MEMSET( (char*)&pLine[ x ], (int)v, len );
+			break;
+
+		case 16 :
+			ezd_span_px( pLine, x, len, 2, (int)v );
+			break;
+
+	} // end switch
+}
+
+/// Draws a horizontal run between x1 and x2 inclusive, clipped to the clip rect
+static int ezd_hline( SImageData *p, int x1, int x2, int y, int col )
+{
+	unsigned char *pLine;
+
+	if ( y < p->nClipTop || y >= p->nClipBottom )
+		return 1;
+
+	if ( x1 > x2 )
+	{	int t = x1; x1 = x2; x2 = t; }
+
+	if ( x1 < p->nClipLeft ) x1 = p->nClipLeft;
+	if ( x2 >= p->nClipRight ) x2 = p->nClipRight - 1;
+	if ( x1 > x2 )
+		return 1;
+
+	if ( EZD_HAS_CALLBACK( p ) )
+		return ezd_cb_span( p, x1, y, x2 - x1 + 1, col, 0 );
+
+	pLine = EZD_ROW( p, y );
+
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			ezd_span_1( pLine, x1, x2 - x1 + 1, EZD_COMPARE_THRESHOLD( col, p->colThreshold ) );
+			break;
+
+		case 24 :
+		case 32 :
+			if ( EZD_BLENDS( p, col ) )
+				ezd_blend_span( p, &pLine[ x1 * 4 ], x2 - x1 + 1, col );
+			else
+				ezd_span_px( pLine, x1, x2 - x1 + 1, p->nPixel, col );
+			break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+			ezd_span_v( p, pLine, x1, x2 - x1 + 1, ezd_color_px( p, col ) );
+			break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	return 1;
+}
+
+/// Draws a vertical run between y1 and y2 inclusive, clipped to the clip rect
+static int ezd_vline( SImageData *p, int x, int y1, int y2, int col )
+{
+	int sw, n;
+	unsigned char *pPos;
+
+	if ( x < p->nClipLeft || x >= p->nClipRight )
+		return 1;
+
+	if ( y1 > y2 )
+	{	int t = y1; y1 = y2; y2 = t; }
+
+	if ( y1 < p->nClipTop ) y1 = p->nClipTop;
+	if ( y2 >= p->nClipBottom ) y2 = p->nClipBottom - 1;
+	if ( y1 > y2 )
+		return 1;
+
+	if ( EZD_HAS_CALLBACK( p ) )
+		return ezd_cb_vspan( p, x, y1, y2 - y1 + 1, col );
+
+	sw = p->nStride;
+	pPos = EZD_ROW( p, y1 );
+	n = y2 - y1 + 1;
+
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+		{
+			unsigned char m = (unsigned char)( 0x80 >> ( x & 7 ) );
+			pPos += x >> 3;
+			if ( EZD_COMPARE_THRESHOLD( col, p->colThreshold ) )
+				for ( ; 0 < n; n--, pPos += sw )
+					*pPos |= m;
+			else
+				for ( ; 0 < n; n--, pPos += sw )
+					*pPos &= ~m;
+		} break;
+
+		case 24 :
+		{
+			unsigned char r = col & 0xff;
+			unsigned char g = ( col >> 8 ) & 0xff;
+			unsigned char b = ( col >> 16 ) & 0xff;
+			for ( pPos += x * 3; 0 < n; n--, pPos += sw )
+				pPos[ 0 ] = r, pPos[ 1 ] = g, pPos[ 2 ] = b;
+		} break;
+
+		case 32 :
+			if ( EZD_BLENDS( p, col ) )
+				for ( pPos += x * 4; 0 < n; n--, pPos += sw )
+					ezd_blend_span( p, pPos, 1, col );
+			else
+				for ( pPos += x * 4; 0 < n; n--, pPos += sw )
+					*(unsigned int*)pPos = col;
+			break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+		{
+			unsigned int v = ezd_color_px( p, col );
+			for ( ; 0 < n; n--, pPos += sw )
+				ezd_span_v( p, pPos, x, 1, v );
+		} break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	return 1;
+}
+
+int ezd_fill( HEZDIMAGE x_hDib, int x_col )
+{
+	int w, h, sw, pw, y, t, stream;
+	unsigned int v;
+	unsigned char pix[ 4 ], pat[ EZD_PATTERN_PERIOD * 2 ];
+	t_ezd_fill_pattern pf;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize 
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Image metrics, only the current band's rows are in memory
+	w = p->nWidth;
+	t = p->nBandTop;
+	h = p->nBandRows ? p->nBandRows : p->nHeight;
+
+	// Only fill the clip rect
+	if ( p->nClipLeft || p->nClipTop != t || p->nClipRight != w || p->nClipBottom != t + h )
+		return ezd_fill_rect( x_hDib, p->nClipLeft, p->nClipTop, p->nClipRight, p->nClipBottom, x_col );
+
+	ezd_dirty( p, 0, t, w, t + h );
+
+	// Check for user callback function
+	if ( EZD_HAS_CALLBACK( p ) )
+	{
+		// Fill each line
+		for ( y = t; y < t + h; y++ )
+			if ( !ezd_cb_span( p, 0, y, w, x_col, 0 ) )
+				return 0;
+
+		return ezd_cb_flush( p );
+
+	} // end if
+
+	// Composite each line
+	if ( EZD_BLENDS( p, x_col ) )
+	{	for ( y = t; y < t + h; y++ )
+			ezd_blend_span( p, EZD_ROW( p, y ), w, x_col );
+		return 1;
+	} // end if
+
+	// Pixel and scan widths
+	pw = p->nPixel;
+	sw = p->nStride;
+
+	// Build the pixel pattern
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			pix[ 0 ] = EZD_COMPARE_THRESHOLD( x_col, p->colThreshold ) ? 0xff : 0;
+			break;
+
+		case 24 :
+			pix[ 0 ] = x_col & 0xff;
+			pix[ 1 ] = ( x_col >> 8 ) & 0xff;
+			pix[ 2 ] = ( x_col >> 16 ) & 0xff;
+			break;
+
+		case 32 :
+			*(unsigned int*)pix = x_col;
+			break;
+
+		// Two pixels per byte
+		case 4 :
+			pix[ 0 ] = (unsigned char)( ezd_color_px( p, x_col ) * 0x11 );
+			break;
+
+		case 8 :
+		case 16 :
+			v = ezd_color_px( p, x_col );
+			pix[ 0 ] = v & 0xff, pix[ 1 ] = ( v >> 8 ) & 0xff;
+			break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	ezd_make_pattern( pat, pix, pw );
+	pf = ezd_get_fill_pattern();
+
+	// Bypass the cache for large images
+	stream = 0 < EZD_STREAM_THRESHOLD && EZD_STREAM_THRESHOLD <= (int)p->bih.biSizeImage;
+
+	// Fill the whole image at once if there is no line padding
+	if ( 8 > p->bih.biBitCount || sw == w * pw )
+		pf( p->pImage, sw * h, pat, stream );
+
+	// Fill each line
+	else
+		for( y = t; y < t + h; y++ )
+			pf( EZD_ROW( p, y ), w * pw, pat, stream );
+
+	return 1;
+}
+
+int ezd_set_pixel( HEZDIMAGE x_hDib, int x, int y, int x_col )
+{
+	unsigned char *pLine;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Ensure pixel is within the image
+	if ( 0 > x || x >= p->nWidth || 0 > y || y >= p->nHeight )
+	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, p->nWidth, p->nHeight );
+		return 0;
+	} // en dif
+
+	// Skip pixels outside the clip rect
+	if ( !EZD_IN_CLIP( p, x, y ) )
+		return 1;
+
+	ezd_add_dirty( p, x, y, x + 1, y + 1 );
+
+	// Set the specified pixel
+	if ( EZD_HAS_CALLBACK( p ) )
+		return ezd_cb_pixel( p, x, y, x_col, 0 ) && ezd_cb_flush( p );
+
+	pLine = EZD_ROW( p, y );
+
+	// Set the first line
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			if ( EZD_COMPARE_THRESHOLD( x_col, p->colThreshold ) )
+				pLine[ x >> 3 ] |= 0x80 >> ( x & 7 );
+			else
+				pLine[ x >> 3 ] &= ~( 0x80 >> ( x & 7 ) );
+			break;
+
+		case 24 :
+		{
+			// Color values
+			unsigned char r = x_col & 0xff;
+			unsigned char g = ( x_col >> 8 ) & 0xff;
+			unsigned char b = ( x_col >> 16 ) & 0xff;
+			unsigned char *pImg = &pLine[ x * 3 ];
+
+			// Set the pixel color
+			pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
+
+		} break;
+
+		case 32 :
+			if ( EZD_BLENDS( p, x_col ) )
+				ezd_blend_span( p, &pLine[ x * 4 ], 1, x_col );
+			else
+				*(unsigned int*)&pLine[ x * 4 ] = x_col;
+			break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+			ezd_span_v( p, pLine, x, 1, ezd_color_px( p, x_col ) );
+			break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	return 1;
+}
+
+int ezd_get_pixel( HEZDIMAGE x_hDib, int x, int y )
+{
+	unsigned char *pLine;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !p->pImage )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Ensure pixel is within the image
+	if ( 0 > x || x >= p->nWidth || 0 > y || y >= p->nHeight )
+	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, p->nWidth, p->nHeight );
+		return 0;
+	} // en dif
+
+	// Is the row in memory?
+	if ( !EZD_IN_BAND( p, y ) )
+		return 0;
+
+	pLine = EZD_ROW( p, y );
+
+	// Set the first line
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			return p->pPalette[ ( pLine[ x >> 3 ] & ( 0x80 >> ( x & 7 ) ) ) ? 1 : 0 ];
+
+		case 24 :
+		{
+			// Return the color of the specified pixel
+			unsigned char *pImg = &pLine[ x * 3 ];
+			return pImg[ 0 ] | ( pImg[ 1 ] << 8 ) | ( pImg[ 2 ] << 16 );
+
+		} break;
+
+		case 32 :
+			return *(unsigned int*)&pLine[ x * 4 ];
+
+		case 4 :
+		case 8 :
+		case 16 :
+			return ezd_px_color( p, ezd_get_v( p, pLine, x ) );
+
+	} // end switch
+
+	return 0;
+}
+
+/// Sets a list of pixels, pCol is optional and overrides col
+static int ezd_scatter( HEZDIMAGE x_hDib, const int *pXy, const int *pCol, int nPts, int col )
+{
+	int i, x, y, c;
+	unsigned int l, t, cw, ch;
+	unsigned char *pImg;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) || ( !pXy && 0 < nPts ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// One unsigned compare per axis clips each point
+	l = p->nClipLeft, t = p->nClipTop;
+	cw = p->nClipRight - p->nClipLeft;
+	ch = p->nClipBottom - p->nClipTop;
+
+	ezd_dirty_points( p, pXy, nPts );
+
+	if ( EZD_HAS_CALLBACK( p ) )
+	{
+		for ( i = 0; i < nPts; i++ )
+		{	x = pXy[ i * 2 ], y = pXy[ i * 2 + 1 ];
+			if ( (unsigned int)x - l < cw && (unsigned int)y - t < ch )
+				if ( !ezd_cb_pixel( p, x, y, pCol ? pCol[ i ] : col, 0 ) )
+					return 0;
+		} // end for
+
+		return ezd_cb_flush( p );
+
+	} // end if
+
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			c = EZD_COMPARE_THRESHOLD( col, p->colThreshold );
+			for ( i = 0; i < nPts; i++ )
+			{	x = pXy[ i * 2 ], y = pXy[ i * 2 + 1 ];
+				if ( (unsigned int)x - l < cw && (unsigned int)y - t < ch )
+				{	pImg = &EZD_ROW( p, y )[ x >> 3 ];
+					if ( pCol )
+						c = EZD_COMPARE_THRESHOLD( pCol[ i ], p->colThreshold );
+					if ( c )
+						*pImg |= 0x80 >> ( x & 7 );
+					else
+						*pImg &= ~( 0x80 >> ( x & 7 ) );
+				} // end if
+			} // end for
+			break;
+
+		case 24 :
+			for ( i = 0; i < nPts; i++ )
+			{	x = pXy[ i * 2 ], y = pXy[ i * 2 + 1 ];
+				if ( (unsigned int)x - l < cw && (unsigned int)y - t < ch )
+				{	pImg = &EZD_ROW( p, y )[ x * 3 ];
+					c = pCol ? pCol[ i ] : col;
+					pImg[ 0 ] = c & 0xff, pImg[ 1 ] = ( c >> 8 ) & 0xff, pImg[ 2 ] = ( c >> 16 ) & 0xff;
+				} // end if
+			} // end for
+			break;
+
+		case 32 :
+			for ( i = 0; i < nPts; i++ )
+			{	x = pXy[ i * 2 ], y = pXy[ i * 2 + 1 ];
+				if ( (unsigned int)x - l < cw && (unsigned int)y - t < ch )
+				{	pImg = &EZD_ROW( p, y )[ x * 4 ];
+					c = pCol ? pCol[ i ] : col;
+					if ( EZD_BLENDS( p, c ) )
+						ezd_blend_span( p, pImg, 1, c );
+					else
+						*(unsigned int*)pImg = c;
+				} // end if
+			} // end for
+			break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+			c = (int)ezd_color_px( p, col );
+			for ( i = 0; i < nPts; i++ )
+			{	x = pXy[ i * 2 ], y = pXy[ i * 2 + 1 ];
+				if ( (unsigned int)x - l < cw && (unsigned int)y - t < ch )
+					ezd_span_v( p, EZD_ROW( p, y ), x, 1, pCol ? ezd_color_px( p, pCol[ i ] ) : (unsigned int)c );
+			} // end for
+			break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	return 1;
+}
+
+int ezd_set_pixels( HEZDIMAGE x_hDib, const int *x_pXy, int x_nPts, int x_col )
+{
+	return ezd_scatter( x_hDib, x_pXy, 0, x_nPts, x_col );
+}
+
+int ezd_set_pixels_colors( HEZDIMAGE x_hDib, const int *x_pXy, const int *x_pCol, int x_nPts )
+{
+	if ( !x_pCol && 0 < x_nPts )
+		return _ERR( 0, "Invalid parameters" );
+
+	return ezd_scatter( x_hDib, x_pXy, x_pCol, x_nPts, 0 );
+}
+
+/// Returns the color of pixel x in an image row
+static int ezd_read_px( SImageData *p, const unsigned char *pRow, int x )
+{
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			return p->pPalette[ ( pRow[ x >> 3 ] >> ( 7 - ( x & 7 ) ) ) & 1 ];
+
+		case 24 :
+			pRow += x * 3;
+			return pRow[ 0 ] | ( pRow[ 1 ] << 8 ) | ( pRow[ 2 ] << 16 );
+
+		case 32 :
+			return *(const unsigned int*)&pRow[ x * 4 ];
+
+		case 4 :
+		case 8 :
+		case 16 :
+			return ezd_px_color( p, ezd_get_v( p, pRow, x ) );
+
+	} // end switch
+
+	return 0;
+}
+
+/// Composites n 32 bit pixels from pSrc over pDst, the rows may overlap
+static void ezd_blend_row( SImageData *d, unsigned char *pDst, const unsigned char *pSrc, int n )
+{
+	int i, k, nb, pm = EZD_ALPHA_PREMULTIPLIED == d->nAlpha;
+	unsigned char tmp[ 256 * 4 ];
+	t_ezd_blend_copy pf = ezd_get_blend_copy();
+
+	if ( pDst >= pSrc + n * 4 || pSrc >= pDst + n * 4 )
+	{	pf( pDst, pSrc, n, pm );
+		return;
+	} // end if
+
+	// Copy blocks out of the way, starting from the far end if the copy moves right
+	for ( i = 0; i < n; i += 256 )
+	{	nb = ( n - i > 256 ) ? 256 : ( n - i );
+		k = ( pDst > pSrc ) ? n - i - nb : i;
+		EZD_MEMCPY( (char*)tmp, (const char*)&pSrc[ k * 4 ], nb * 4 );
+		pf( &pDst[ k * 4 ], tmp, nb, pm );
+	} // end for
+}
+
+/// Returns non-zero if pixels can be copied between two images as they are
+static int ezd_same_format( SImageData *d, SImageData *s )
+{
+	if ( d->bih.biBitCount != s->bih.biBitCount
+		 || ( EZD_FLAG_RGB555 & d->uFlags ) != ( EZD_FLAG_RGB555 & s->uFlags ) )
+		return 0;
+
+	// 1 bit images copy bits whatever their palettes
+	if ( 4 != d->bih.biBitCount && 8 != d->bih.biBitCount )
+		return 1;
+
+	return ezd_palette_size( d ) == ezd_palette_size( s )
+		   && !EZD_MEMCMP( (const unsigned char*)d->pPalette, (const unsigned char*)s->pPalette,
+						   ezd_palette_size( d ) * sizeof( d->colPalette[ 0 ] ) );
+}
+
+/// Copies n pixels from a source row to a destination row, converting the format unless same is set
+static void ezd_blit_row( SImageData *d, unsigned char *pDst, int dx,
+						  SImageData *s, const unsigned char *pSrc, int sx, int n, int same )
+{
+	int i, k, nb;
+	unsigned int w[ 4 ];
+	unsigned long long v;
+
+	// Same format
+	if ( same && 4 != d->bih.biBitCount )
+	{
+		if ( d->nAlpha )
+		{	ezd_blend_row( d, &pDst[ dx * 4 ], &pSrc[ sx * 4 ], n );
+			return;
+		} // end if
+
+		if ( 1 != d->bih.biBitCount )
+		{	EZD_MEMMOVE( &pDst[ dx * d->nPixel ], &pSrc[ sx * s->nPixel ], n * d->nPixel );
+			return;
+		} // end if
+
+		// Byte aligned bits, the partial byte must be read before it can be overwritten
+		if ( !( ( dx | sx ) & 7 ) )
+		{	k = n & ~7, nb = n & 7;
+			v = nb ? ezd_get_bits( pSrc, sx + k, nb ) : 0;
+			if ( dx <= sx )
+				EZD_MEMMOVE( &pDst[ dx >> 3 ], &pSrc[ sx >> 3 ], k >> 3 );
+			if ( nb )
+				ezd_bits_1( pDst, dx + k, v, nb, 1 ),
+				ezd_bits_1( pDst, dx + k, ~v, nb, 0 );
+			if ( dx > sx )
+				EZD_MEMMOVE( &pDst[ dx >> 3 ], &pSrc[ sx >> 3 ], k >> 3 );
+			return;
+		} // end if
+
+		// Shift 56 bits at a time, backwards if the copy overlaps to the right
+		for ( i = 0; i < n; i += 56 )
+		{	nb = ( n - i > 56 ) ? 56 : ( n - i );
+			k = ( pDst == pSrc && dx > sx ) ? n - i - nb : i;
+			v = ezd_get_bits( pSrc, sx + k, nb );
+			ezd_bits_1( pDst, dx + k, v, nb, 1 );
+			ezd_bits_1( pDst, dx + k, ~v, nb, 0 );
+		} // end for
+
+		return;
+
+	} // end if
+
+	// Byte aligned nibbles, the last one is read before it can be overwritten
+	if ( same && !( ( dx | sx ) & 1 ) )
+	{	k = (int)ezd_get_v( s, pSrc, sx + n - 1 );
+		EZD_MEMMOVE( &pDst[ dx >> 1 ], &pSrc[ sx >> 1 ], n >> 1 );
+		if ( n & 1 )
+			ezd_span_v( d, pDst, dx + n - 1, 1, (unsigned int)k );
+		return;
+	} // end if
+
+	switch( d->bih.biBitCount )
+	{
+		// Threshold into 56 bit chunks
+		case 1 :
+			for ( i = 0; i < n; i += 56 )
+			{	nb = ( n - i > 56 ) ? 56 : ( n - i );
+				for ( k = 0, v = 0; k < nb; k++ )
+					if ( EZD_COMPARE_THRESHOLD( ezd_read_px( s, pSrc, sx + i + k ), d->colThreshold ) )
+						v |= (unsigned long long)1 << ( 63 - k );
+				ezd_bits_1( pDst, dx + i, v, nb, 1 );
+				ezd_bits_1( pDst, dx + i, ~v, nb, 0 );
+			} // end for
+			break;
+
+		case 24 :
+			pDst += dx * 3;
+
+			// Four pixels are three words
+			if ( 32 == s->bih.biBitCount )
+			{	pSrc += sx * 4;
+				for ( i = 0; i + 4 <= n; i += 4, pSrc += 16, pDst += 12 )
+				{	EZD_MEMCPY( w, pSrc, 16 );
+					w[ 0 ] = ( w[ 0 ] & 0xffffff ) | ( w[ 1 ] << 24 );
+					w[ 1 ] = ( ( w[ 1 ] >> 8 ) & 0xffff ) | ( w[ 2 ] << 16 );
+					w[ 2 ] = ( ( w[ 2 ] >> 16 ) & 0xff ) | ( w[ 3 ] << 8 );
+					EZD_MEMCPY( pDst, w, 12 );
+				} // end for
+				for ( ; i < n; i++, pSrc += 4, pDst += 3 )
+					pDst[ 0 ] = pSrc[ 0 ], pDst[ 1 ] = pSrc[ 1 ], pDst[ 2 ] = pSrc[ 2 ];
+			} // end if
+
+			else
+				for ( i = 0; i < n; i++, pDst += 3 )
+				{	k = ezd_read_px( s, pSrc, sx + i );
+					pDst[ 0 ] = k & 0xff, pDst[ 1 ] = ( k >> 8 ) & 0xff, pDst[ 2 ] = ( k >> 16 ) & 0xff;
+				} // end for
+			break;
+
+		case 32 :
+			pDst += dx * 4;
+
+			// Three words are four pixels
+			if ( 24 == s->bih.biBitCount )
+			{	pSrc += sx * 3;
+				for ( i = 0; i + 4 <= n; i += 4, pSrc += 12, pDst += 16 )
+				{	EZD_MEMCPY( w, pSrc, 12 );
+					w[ 3 ] = w[ 2 ] >> 8;
+					w[ 2 ] = ( w[ 1 ] >> 16 ) | ( ( w[ 2 ] & 0xff ) << 16 );
+					w[ 1 ] = ( w[ 0 ] >> 24 ) | ( ( w[ 1 ] & 0xffff ) << 8 );
+					w[ 0 ] &= 0xffffff;
+					EZD_MEMCPY( pDst, w, 16 );
+				} // end for
+				for ( ; i < n; i++, pSrc += 3, pDst += 4 )
+					*(unsigned int*)pDst = pSrc[ 0 ] | ( pSrc[ 1 ] << 8 ) | ( pSrc[ 2 ] << 16 );
+			} // end if
+
+			else
+				for ( i = 0; i < n; i++, pDst += 4 )
+					*(unsigned int*)pDst = ezd_read_px( s, pSrc, sx + i );
+
+			// Sources without alpha are opaque
+			if ( d->nAlpha )
+				for ( pDst -= n * 4, i = 0; i < n; i++, pDst += 4 )
+					pDst[ 3 ] = 0xff;
+			break;
+
+		// A pixel at a time, backwards if the copy overlaps to the right
+		case 4 :
+		case 8 :
+		case 16 :
+			for ( i = 0; i < n; i++ )
+			{	k = ( pDst == pSrc && dx > sx ) ? n - 1 - i : i;
+				ezd_span_v( d, pDst, dx + k, 1, same ? ezd_get_v( s, pSrc, sx + k )
+											  : ezd_color_px( d, ezd_read_px( s, pSrc, sx + k ) ) );
+			} // end for
+			break;
+
+	} // end switch
+}
+
+int ezd_blit( HEZDIMAGE x_hDst, int x_dx, int x_dy, HEZDIMAGE x_hSrc, int x_sx, int x_sy, int x_w, int x_h )
+{
+	int i, k, j0, j1, i0, i1, n, flip, back, sy, c, run, same;
+	SImageData *d = (SImageData*)x_hDst, *s = (SImageData*)x_hSrc;
+
+	if ( !d || sizeof( SBitmapInfoHeader ) != d->bih.biSize
+		 || !EZD_CAN_DRAW( d )
+		 || !s || sizeof( SBitmapInfoHeader ) != s->bih.biSize || !s->pImage )
+		return _ERR( 0, "Invalid parameters" );
+
+	if ( !EZD_VALID_BPP( s->bih.biBitCount ) )
+		return _ERR( 0, "Invalid source pixel depth" );
+
+	if ( !EZD_HAS_CALLBACK( d ) && !EZD_VALID_BPP( d->bih.biBitCount ) )
+		return _ERR( 0, "Invalid destination pixel depth" );
+
+	// Keep rows the right way up between top down and bottom up images
+	flip = ( 0 < d->bih.biHeight ) != ( 0 < s->bih.biHeight );
+
+	// Columns inside the destination clip rect and the source image
+	j0 = 0, j1 = x_w;
+	if ( j0 < d->nClipLeft - x_dx ) j0 = d->nClipLeft - x_dx;
+	if ( j0 < -x_sx ) j0 = -x_sx;
+	if ( j1 > d->nClipRight - x_dx ) j1 = d->nClipRight - x_dx;
+	if ( j1 > s->nWidth - x_sx ) j1 = s->nWidth - x_sx;
+
+	// Rows, source row i is x_sy + i, or x_sy + x_h - 1 - i if flipped
+	i0 = 0, i1 = x_h;
+	if ( i0 < d->nClipTop - x_dy ) i0 = d->nClipTop - x_dy;
+	if ( i1 > d->nClipBottom - x_dy ) i1 = d->nClipBottom - x_dy;
+	if ( !flip )
+	{	if ( i0 < -x_sy ) i0 = -x_sy;
+		if ( i1 > s->nHeight - x_sy ) i1 = s->nHeight - x_sy;
+	} // end if
+	else
+	{	if ( i0 < x_sy + x_h - s->nHeight ) i0 = x_sy + x_h - s->nHeight;
+		if ( i1 > x_sy + x_h ) i1 = x_sy + x_h;
+	} // end else
+
+	if ( j0 >= j1 || i0 >= i1 )
+		return 1;
+
+	ezd_add_dirty( d, x_dx + j0, x_dy + i0, x_dx + j1, x_dy + i1 );
+
+	n = j1 - j0;
+	same = ezd_same_format( d, s );
+
+	// Copy from the bottom if an overlapping copy moves down
+	back = s->pImage == d->pImage && x_dy > x_sy;
+
+	for ( k = 0; k < i1 - i0; k++ )
+	{
+		i = back ? i1 - 1 - k : i0 + k;
+		sy = flip ? x_sy + x_h - 1 - i : x_sy + i;
+
+		// Skip source rows outside its current band
+		if ( !EZD_IN_BAND( s, sy ) )
+			continue;
+
+		if ( !EZD_HAS_CALLBACK( d ) )
+		{	ezd_blit_row( d, EZD_ROW( d, x_dy + i ), x_dx + j0, s, EZD_ROW( s, sy ), x_sx + j0, n, same );
+			continue;
+		} // end if
+
+		// Pass runs of the same color to the callback
+		for ( run = 0, c = 0; run < n; )
+		{	int x = run;
+			c = ezd_read_px( s, EZD_ROW( s, sy ), x_sx + j0 + x );
+			while ( ++run < n && ezd_read_px( s, EZD_ROW( s, sy ), x_sx + j0 + run ) == c )
+				;
+			if ( !ezd_cb_span( d, x_dx + j0 + x, x_dy + i, run - x, c, 0 ) )
+				return 0;
+		} // end for
+
+	} // end for
+
+	return EZD_HAS_CALLBACK( d ) ? ezd_cb_flush( d ) : 1;
+}
+
+/// Bresenham line state after clipping
+typedef struct _SLineStep
+{
+	/// First visible pixel
+	int				x, y;
+
+	/// Number of visible pixels
+	int				n;
+
+	/// Step directions
+	int				sx, sy;
+
+	/// Non-zero if x is the major axis
+	int				xmajor;
+
+	/// Error term, error increment and error limit
+	long long		e, de, dm;
+
+} SLineStep;
+
+/// Returns a * b / c rounded down and the remainder in *r
+/**
+	a must be below 2^32 and b and c below 2^34, the 16 bit steps
+	keep the product from overflowing 64 bits.
+*/
+static long long ezd_mul_div( long long a, long long b, long long c, long long *r )
+{
+	unsigned long long q = 0, m = 0, d;
+	int s;
+
+	for ( s = 32; 0 <= s; s -= 16 )
+	{	d = m * 65536 + (unsigned long long)a * ( ( (unsigned long long)b >> s ) & 0xffff );
+		q = q * 65536 + d / (unsigned long long)c, m = d % (unsigned long long)c;
+	} // end for
+
+	*r = (long long)m;
+	return (long long)q;
+}
+
+/// Clips a line to the clip rectangle without changing the pixels it covers
+/**
+	The minor axis offset of step i is floor( ( 2 * dmin * i + dmaj ) / ( 2 * dmaj ) ),
+	so the first and last visible steps can be found directly instead
+	of stepping up to the clip rectangle.  The line must not be
+	horizontal or vertical.
+
+	\return Zero if no part of the line is visible
+*/
+static int ezd_clip_line( SImageData *p, int x1, int y1, int x2, int y2, SLineStep *l )
+{
+	long long dx = (long long)x2 - x1, dy = (long long)y2 - y1;
+	long long M1, m1, dM, dm, LM, RM, Lm, Rm, i0, i1, k0, k1, t, m;
+	int sM, sm;
+
+	l->sx = ( 0 < dx ) ? 1 : -1; dx = EZD_ABS( dx );
+	l->sy = ( 0 < dy ) ? 1 : -1; dy = EZD_ABS( dy );
+	l->xmajor = dx >= dy;
+
+	// Sort into major and minor axis
+	if ( l->xmajor )
+		M1 = x1, m1 = y1, dM = dx, dm = dy, sM = l->sx, sm = l->sy,
+		LM = p->nClipLeft, RM = p->nClipRight - 1, Lm = p->nClipTop, Rm = p->nClipBottom - 1;
+	else
+		M1 = y1, m1 = x1, dM = dy, dm = dx, sM = l->sy, sm = l->sx,
+		LM = p->nClipTop, RM = p->nClipBottom - 1, Lm = p->nClipLeft, Rm = p->nClipRight - 1;
+
+	// Steps inside the clip rect along the major axis
+	i0 = ( 0 < sM ) ? LM - M1 : M1 - RM;
+	i1 = ( 0 < sM ) ? RM - M1 : M1 - LM;
+	if ( 0 > i0 ) i0 = 0;
+	if ( dM < i1 ) i1 = dM;
+
+	// Minor axis offsets inside the clip rect
+	k0 = ( 0 < sm ) ? Lm - m1 : m1 - Rm;
+	k1 = ( 0 < sm ) ? Rm - m1 : m1 - Lm;
+	if ( 0 > k0 ) k0 = 0;
+	if ( dm < k1 ) k1 = dm;
+	if ( k0 > k1 || i0 > i1 )
+		return 0;
+
+	// First step reaching minor offset k0, ceil( dM * ( 2 * k0 - 1 ) / ( 2 * dm ) )
+	if ( 0 < k0 )
+	{	t = ezd_mul_div( dM, 2 * k0 - 1, 2 * dm, &m ) + ( m ? 1 : 0 );
+		if ( t > i0 ) i0 = t;
+	} // end if
+
+	// Last step before minor offset k1 + 1
+	if ( dm > k1 )
+	{	t = ezd_mul_div( dM, 2 * k1 + 1, 2 * dm, &m ) + ( m ? 1 : 0 ) - 1;
+		if ( t < i1 ) i1 = t;
+	} // end if
+
+	if ( i0 > i1 )
+		return 0;
+
+	// Starting state, ( 2 * dm * i0 + dM ) / ( 2 * dM ) and its remainder
+	l->dm = 2 * dM;
+	l->de = 2 * dm;
+	t = ezd_mul_div( dm, 2 * i0, l->dm, &m );
+	if ( ( m += dM ) >= l->dm )
+		t++, m -= l->dm;
+	l->e = m;
+	l->n = (int)( i1 - i0 + 1 );
+
+	if ( l->xmajor )
+		l->x = (int)( M1 + sM * i0 ), l->y = (int)( m1 + sm * t );
+	else
+		l->y = (int)( M1 + sM * i0 ), l->x = (int)( m1 + sm * t );
+
+	return 1;
+}
+
+int ezd_line( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+{
+	int sw, pw, n;
+	long long e;
+	SLineStep l;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	ezd_dirty( p, ( x1 < x2 ) ? x1 : x2, ( y1 < y2 ) ? y1 : y2,
+			   ( ( x1 < x2 ) ? x2 : x1 ) + 1LL, ( ( y1 < y2 ) ? y2 : y1 ) + 1LL );
+
+	// Horizontal line
+	if ( y1 == y2 )
+		return ezd_hline( p, x1, x2, y1, x_col ) && ezd_cb_flush( p );
+
+	// Vertical line
+	if ( x1 == x2 )
+		return ezd_vline( p, x1, y1, y2, x_col ) && ezd_cb_flush( p );
+
+	// Skip the part of the line outside the clip rect
+	if ( !ezd_clip_line( p, x1, y1, x2, y2, &l ) )
+		return 1;
+
+	n = l.n;
+	e = l.e;
+
+	// Check for user callback function
+	if ( EZD_HAS_CALLBACK( p ) )
+	{
+		// Pass runs along x
+		if ( l.xmajor )
+		{	int rx = l.x;
+			for ( ; ; )
+			{	if ( !--n )
+					break;
+				l.x += l.sx, e += l.de;
+				if ( e >= l.dm )
+				{	if ( !ezd_cb_span( p, ( 0 < l.sx ) ? rx : l.x + 1, l.y, EZD_ABS( l.x - rx ), x_col, 0 ) )
+						return 0;
+					e -= l.dm, l.y += l.sy, rx = l.x;
+				} // end if
+			} // end for
+
+			return ezd_cb_span( p, ( 0 < l.sx ) ? rx : l.x, l.y, EZD_ABS( l.x - rx ) + 1, x_col, 0 )
+				   && ezd_cb_flush( p );
+
+		} // end if
+
+		// One pixel per line
+		for ( ; ; )
+		{	if ( !ezd_cb_pixel( p, l.x, l.y, x_col, 0 ) )
+				return 0;
+			if ( !--n )
+				break;
+			l.y += l.sy, e += l.de;
+			if ( e >= l.dm )
+				e -= l.dm, l.x += l.sx;
+		} // end for
+
+		return ezd_cb_flush( p );
+
+	} // end if
+
+	// Pixel and scan width
+	pw = p->nPixel;
+	sw = p->nStride;
+
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+		{
+			int c = EZD_COMPARE_THRESHOLD( x_col, p->colThreshold );
+			unsigned char *pLine = EZD_ROW( p, l.y );
+
+			// Draw runs along x
+			if ( l.xmajor )
+			{	int rx = l.x;
+				for ( ; ; )
+				{	if ( !--n )
+						break;
+					l.x += l.sx, e += l.de;
+					if ( e >= l.dm )
+					{	ezd_span_1( pLine, ( 0 < l.sx ) ? rx : l.x + 1, EZD_ABS( l.x - rx ), c );
+						e -= l.dm, pLine += l.sy * sw, rx = l.x;
+					} // end if
+				} // end for
+
+				ezd_span_1( pLine, ( 0 < l.sx ) ? rx : l.x, EZD_ABS( l.x - rx ) + 1, c );
+
+			} // end if
+
+			// One bit per line
+			else
+				for ( ; ; )
+				{	if ( c )
+						pLine[ l.x >> 3 ] |= 0x80 >> ( l.x & 7 );
+					else
+						pLine[ l.x >> 3 ] &= ~( 0x80 >> ( l.x & 7 ) );
+					if ( !--n )
+						break;
+					pLine += l.sy * sw, e += l.de;
+					if ( e >= l.dm )
+						e -= l.dm, l.x += l.sx;
+				} // end for
+
+		} break;
+
+		case 24 :
+		{
+			// Color values
+			unsigned char r = x_col & 0xff;
+			unsigned char g = ( x_col >> 8 ) & 0xff;
+			unsigned char b = ( x_col >> 16 ) & 0xff;
+			unsigned char *pImg = &EZD_ROW( p, l.y )[ l.x * pw ];
+			int sM = l.xmajor ? l.sx * pw : l.sy * sw;
+			int sm = l.xmajor ? l.sy * sw : l.sx * pw;
+
+			for ( ; ; )
+			{	pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
+				if ( !--n )
+					break;
+				pImg += sM, e += l.de;
+				if ( e >= l.dm )
+					e -= l.dm, pImg += sm;
+			} // end for
+
+		} break;
+
+		case 32 :
+		{
+			int bl = EZD_BLENDS( p, x_col );
+			unsigned char *pImg = &EZD_ROW( p, l.y )[ l.x * pw ];
+			int sM = l.xmajor ? l.sx * pw : l.sy * sw;
+			int sm = l.xmajor ? l.sy * sw : l.sx * pw;
+
+			for ( ; ; )
+			{	if ( bl )
+					ezd_blend_span( p, pImg, 1, x_col );
+				else
+					*(unsigned int*)pImg = x_col;
+				if ( !--n )
+					break;
+				pImg += sM, e += l.de;
+				if ( e >= l.dm )
+					e -= l.dm, pImg += sm;
+			} // end for
+
+		} break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+		{
+			unsigned int v = ezd_color_px( p, x_col );
+			unsigned char *pLine = EZD_ROW( p, l.y );
+
+			// Draw runs along x
+			if ( l.xmajor )
+			{	int rx = l.x;
+				for ( ; ; )
+				{	if ( !--n )
+						break;
+					l.x += l.sx, e += l.de;
+					if ( e >= l.dm )
+					{	ezd_span_v( p, pLine, ( 0 < l.sx ) ? rx : l.x + 1, EZD_ABS( l.x - rx ), v );
+						e -= l.dm, pLine += l.sy * sw, rx = l.x;
+					} // end if
+				} // end for
+
+				ezd_span_v( p, pLine, ( 0 < l.sx ) ? rx : l.x, EZD_ABS( l.x - rx ) + 1, v );
+
+			} // end if
+
+			// One pixel per line
+			else
+				for ( ; ; )
+				{	ezd_span_v( p, pLine, l.x, 1, v );
+					if ( !--n )
+						break;
+					pLine += l.sy * sw, e += l.de;
+					if ( e >= l.dm )
+						e -= l.dm, l.x += l.sx;
+				} // end for
+
+		} break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	return 1;
+}
+
+/// Blends col into pixel x, y with a coverage of cv / 255
+/**
+	1 bit images and the user callbacks get the pixel if it is at
+	least half covered.  4, 8 and 16 bit images blend the colors
+	and store the nearest pixel.
+*/
+static int ezd_aa_px( SImageData *p, int x, int y, int col, int cv )
+{
+	int i, t;
+	unsigned int c;
+	unsigned char *pPx;
+
+	if ( 0 >= cv || !EZD_IN_CLIP( p, x, y ) )
+		return 1;
+
+	if ( EZD_HAS_CALLBACK( p ) )
+		return ( 128 > cv ) || ezd_cb_pixel( p, x, y, col, 0 );
+
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			if ( 128 > cv )
+				break;
+			if ( EZD_COMPARE_THRESHOLD( col, p->colThreshold ) )
+				EZD_ROW( p, y )[ x >> 3 ] |= 0x80 >> ( x & 7 );
+			else
+				EZD_ROW( p, y )[ x >> 3 ] &= ~( 0x80 >> ( x & 7 ) );
+			break;
+
+		case 24 :
+		case 32 :
+			pPx = &EZD_ROW( p, y )[ x * p->nPixel ];
+
+			// Mix the color with the pixel
+			if ( !p->nAlpha )
+			{	for ( i = 0; i < p->nPixel; i++ )
+				{	t = ( ( col >> ( i * 8 ) ) & 0xff ) * cv + pPx[ i ] * ( 255 - cv ) + 128;
+					pPx[ i ] = (unsigned char)( ( t + ( t >> 8 ) ) >> 8 );
+				} // end for
+				break;
+			} // end if
+
+			// Scale the alpha, or the whole color if it is premultiplied
+			c = (unsigned int)col;
+			for ( i = ( EZD_ALPHA_PREMULTIPLIED == p->nAlpha ) ? 0 : 3; i < 4; i++ )
+			{	t = ( ( c >> ( i * 8 ) ) & 0xff ) * cv + 128;
+				c = ( c & ~( 0xffu << ( i * 8 ) ) ) | ( (unsigned int)( ( t + ( t >> 8 ) ) >> 8 ) << ( i * 8 ) );
+			} // end for
+
+			if ( EZD_BLENDS( p, (int)c ) )
+				ezd_blend_span( p, pPx, 1, (int)c );
+			else
+				*(unsigned int*)pPx = c;
+			break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+			pPx = EZD_ROW( p, y );
+			c = (unsigned int)ezd_read_px( p, pPx, x );
+			for ( i = 0; i < 3; i++ )
+			{	t = ( ( col >> ( i * 8 ) ) & 0xff ) * cv + ( ( c >> ( i * 8 ) ) & 0xff ) * ( 255 - cv ) + 128;
+				c = ( c & ~( 0xffu << ( i * 8 ) ) ) | ( (unsigned int)( ( t + ( t >> 8 ) ) >> 8 ) << ( i * 8 ) );
+			} // end for
+			ezd_span_v( p, pPx, x, 1, ezd_color_px( p, (int)c ) );
+			break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	return 1;
+}
+
+int ezd_line_aa( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+{
+	int f, sm, xmajor, ok;
+	long long dx, dy, dM, dm, M1, m1, lo, hi, mlo, mhi, i, i1, q, r, rcp, m;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Coverage spills one pixel either side
+	ezd_dirty( p, ( ( x1 < x2 ) ? x1 : x2 ) - 1LL, ( ( y1 < y2 ) ? y1 : y2 ) - 1LL,
+			   ( ( x1 < x2 ) ? x2 : x1 ) + 2LL, ( ( y1 < y2 ) ? y2 : y1 ) + 2LL );
+
+	dx = (long long)x2 - x1, dy = (long long)y2 - y1;
+	xmajor = EZD_ABS( dx ) >= EZD_ABS( dy );
+
+	// Always step forward along the major axis
+	if ( xmajor ? 0 > dx : 0 > dy )
+	{	int t = x1; x1 = x2; x2 = t;
+		t = y1; y1 = y2; y2 = t;
+		dx = -dx, dy = -dy;
+	} // end if
+
+	// Sort into major and minor axis
+	if ( xmajor )
+		M1 = x1, m1 = y1, dM = dx, dm = dy,
+		lo = p->nClipLeft, hi = p->nClipRight, mlo = p->nClipTop, mhi = p->nClipBottom;
+	else
+		M1 = y1, m1 = x1, dM = dy, dm = dx,
+		lo = p->nClipTop, hi = p->nClipBottom, mlo = p->nClipLeft, mhi = p->nClipRight;
+
+	sm = ( 0 > dm ) ? -1 : 1;
+	dm = EZD_ABS( dm );
+
+	// Steps inside the clip rect along the major axis
+	i = ( lo > M1 ) ? lo - M1 : 0;
+	i1 = ( hi - 1 - M1 < dM ) ? hi - 1 - M1 : dM;
+	if ( i > i1 )
+		return 1;
+
+	// The minor offset is q + r / dM, and r * rcp >> 32 is r / dM in 256ths
+	rcp = dM ? ( (long long)1 << 40 ) / dM : 0;
+	q = dM ? dm * i / dM : 0;
+	r = dM ? dm * i % dM : 0;
+
+	for ( ; i <= i1; i++ )
+	{
+		// Split the pixel between the two nearest on the minor axis
+		m = m1 + sm * q;
+		if ( mlo - 1 <= m && m <= mhi )
+		{	f = (int)( ( r * rcp ) >> 32 );
+			if ( xmajor )
+				ok = ezd_aa_px( p, (int)( M1 + i ), (int)m, x_col, 255 - f )
+					 && ezd_aa_px( p, (int)( M1 + i ), (int)m + sm, x_col, f );
+			else
+				ok = ezd_aa_px( p, (int)m, (int)( M1 + i ), x_col, 255 - f )
+					 && ezd_aa_px( p, (int)m + sm, (int)( M1 + i ), x_col, f );
+			if ( !ok )
+				return 0;
+		} // end if
+
+		// Step the minor axis
+		r += dm;
+		if ( r >= dM )
+			r -= dM, q++;
+
+	} // end for
+
+	return EZD_HAS_CALLBACK( p ) ? ezd_cb_flush( p ) : 1;
+}
+
+int ezd_rect( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+{
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	if ( y1 > y2 ) { int t = y1; y1 = y2; y2 = t; }
+
+	ezd_dirty( p, ( x1 < x2 ) ? x1 : x2, y1, ( ( x1 < x2 ) ? x2 : x1 ) + 1LL, y2 + 1LL );
+
+	// Draw each pixel once so blended corners match the edges
+	return 		ezd_hline( p, x1, x2, y1, x_col )
+		   &&	( (long long)y2 - y1 < 2 || ezd_vline( p, x2, y1 + 1, y2 - 1, x_col ) )
+		   &&	( y1 == y2 || ezd_hline( p, x1, x2, y2, x_col ) )
+		   &&	( (long long)y2 - y1 < 2 || x1 == x2 || ezd_vline( p, x1, y1 + 1, y2 - 1, x_col ) )
+		   &&	ezd_cb_flush( p );
+}
+
+#define EZD_PI		( (double)3.141592654 )
+#define EZD_PI2		( EZD_PI * (double)2 )
+#define EZD_PI4		( EZD_PI * (double)4 )
+
+/// Fixed point scale of the arc end point vectors
+#define EZD_ARC_ONE		( 1 << 14 )
+
+/// Returns the sine and cosine of an angle scaled by EZD_ARC_ONE
+static void ezd_sincos( double a, int *pCos, int *pSin )
+{
+#if !defined( EZD_NO_MATH )
+	*pCos = (int)( cos( a ) * EZD_ARC_ONE );
+	*pSin = (int)( sin( a ) * EZD_ARC_ONE );
+#else
+	int i;
+	double x, x2, t, s, c;
+
+	// Reduce to -pi .. pi
+	a -= EZD_PI2 * (double)(long long)( a / EZD_PI2 );
+	if ( a > EZD_PI ) a -= EZD_PI2;
+	else if ( a < -EZD_PI ) a += EZD_PI2;
+
+	// Taylor series converge quickly from here
+	for ( i = 0; i < 2; i++ )
+	{
+		// sin( a ), then cos( a ) = sin( a + pi/2 )
+		x = i ? ( a + EZD_PI / 2 ) : a;
+		if ( x > EZD_PI ) x -= EZD_PI2;
+
+		// Fold into -pi/2 .. pi/2
+		if ( x > EZD_PI / 2 ) x = EZD_PI - x;
+		else if ( x < -EZD_PI / 2 ) x = -EZD_PI - x;
+
+		x2 = x * x, t = x, s = x;
+		t *= -x2 / 6, s += t;
+		t *= -x2 / 20, s += t;
+		t *= -x2 / 42, s += t;
+		t *= -x2 / 72, s += t;
+		t *= -x2 / 110, s += t;
+
+		if ( i ) c = s; else *pSin = (int)( s * EZD_ARC_ONE );
+
+	} // end for
+
+	*pCos = (int)( c * EZD_ARC_ONE );
+#endif
+}
+
+/// Classifies each octant of a circle against the arc s .. e
+/**
+	0 <= s < 2pi and s <= e < s + 2pi.  Sets each entry to 0 if the
+	octant is outside the arc, 2 if it is entirely inside, and
+	1 if points must be tested individually.
+*/
+static void ezd_arc_octants( double s, double e, unsigned char *pOct )
+{
+	int i, k;
+	double a0, a1;
+
+	for ( i = 0; i < 8; i++ )
+	{
+		pOct[ i ] = 0;
+
+		// The arc may wrap past 2pi
+		for ( k = 0; k < 2; k++ )
+		{
+			a0 = (double)i * EZD_PI / 4 + (double)k * EZD_PI2;
+			a1 = a0 + EZD_PI / 4;
+
+			if ( s <= a0 && a1 <= e )
+			{	pOct[ i ] = 2;
+				break;
+			} // end if
+
+			if ( s <= a1 && a0 <= e )
+				pOct[ i ] = 1;
+
+		} // end for
+
+	} // end for
+}
+
+/// Octant transforms, x and y swapped, x sign, y sign
+static const signed char ezd_octant[ 8 ][ 3 ] =
+{
+	{ 1, 1, 1 }, { 0, 1, 1 }, { 0, -1, 1 }, { 1, -1, 1 },
+	{ 1, -1, -1 }, { 0, -1, -1 }, { 0, 1, -1 }, { 1, 1, -1 }
+};
+
+int ezd_arc( HEZDIMAGE x_hDib, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col )
+{
+	int c, o, cx, cy, dx, dy, sc, ss, ec, es, wide, skip;
+	long long d, px, py;
+	unsigned char oct[ 8 ];
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Dont' draw null arc
+	if ( x_dStart == x_dEnd || 0 > x_rad )
+		return 1;
+
+	// Ensure correct order
+	else if ( x_dStart > x_dEnd )
+	{	double t = x_dStart;
+		x_dStart = x_dEnd;
+		x_dEnd = t;
+	} // end if
+
+	// Skip circles entirely outside the clip rect
+	if ( (long long)x + x_rad < p->nClipLeft || (long long)x - x_rad >= p->nClipRight
+		 || (long long)y + x_rad < p->nClipTop || (long long)y - x_rad >= p->nClipBottom )
+		return 1;
+
+	ezd_dirty( p, (long long)x - x_rad, (long long)y - x_rad, (long long)x + x_rad + 1, (long long)y + x_rad + 1 );
+
+	// Full circle?
+	if ( EZD_PI2 <= x_dEnd - x_dStart )
+	{	EZD_MEMSET( oct, 2, sizeof( oct ) );
+		sc = ss = ec = es = wide = 0;
+	} // end if
+
+	else
+	{
+		// Start angle in 0 .. 2pi
+		double s = x_dStart - EZD_PI2 * (double)(long long)( x_dStart / EZD_PI2 );
+		if ( 0 > s )
+			s += EZD_PI2;
+
+		// Which octants need per point tests
+		ezd_arc_octants( s, s + x_dEnd - x_dStart, oct );
+
+		// End point vectors for the cross product tests
+		ezd_sincos( x_dStart, &sc, &ss );
+		ezd_sincos( x_dEnd, &ec, &es );
+		wide = EZD_PI < x_dEnd - x_dStart;
+
+	} // end else
+
+	// Pixel value for 1, 4, 8 and 16 bit images
+	c = (int)ezd_color_px( p, x_col );
+
+	// Midpoint circle, cx <= cy covers one octant
+	cx = 0, cy = x_rad, d = 1 - x_rad;
+	while ( cx <= cy )
+	{
+		// Don't plot points shared by two octants twice
+		skip = !cy ? 0xfe : !cx ? 0xd4 : ( cx == cy ) ? 0xaa : 0;
+
+		for ( o = 0; o < 8; o++ )
+		{
+			if ( !oct[ o ] || ( skip & ( 1 << o ) ) )
+				continue;
+
+			// Offset for this octant
+			dx = ezd_octant[ o ][ 0 ] ? cy : cx;
+			dy = ezd_octant[ o ][ 0 ] ? cx : cy;
+			dx *= ezd_octant[ o ][ 1 ];
+			dy *= ezd_octant[ o ][ 2 ];
+
+			// Is it between the end points?
+			if ( 1 == oct[ o ] )
+			{	int a = (long long)sc * dy - (long long)ss * dx >= 0;
+				int b = (long long)dx * es - (long long)dy * ec >= 0;
+				if ( wide ? !( a || b ) : !( a && b ) )
+					continue;
+			} // end if
+
+			px = (long long)x + dx, py = (long long)y + dy;
+			if ( !EZD_IN_CLIP( p, px, py ) )
+				continue;
+
+			// Plot the pixel
+			if ( EZD_HAS_CALLBACK( p ) )
+			{	if ( !ezd_cb_pixel( p, (int)px, (int)py, x_col, 0 ) )
+					return 0;
+			} // end if
+
+			else switch( p->bih.biBitCount )
+			{
+				case 1 :
+					if ( c )
+						EZD_ROW( p, py )[ px >> 3 ] |= 0x80 >> ( px & 7 );
+					else
+						EZD_ROW( p, py )[ px >> 3 ] &= ~( 0x80 >> ( px & 7 ) );
+					break;
+
+				case 24 :
+				{	unsigned char *pImg = &EZD_ROW( p, py )[ px * 3 ];
+					pImg[ 0 ] = x_col & 0xff;
+					pImg[ 1 ] = ( x_col >> 8 ) & 0xff;
+					pImg[ 2 ] = ( x_col >> 16 ) & 0xff;
+				} break;
+
+				case 32 :
+					if ( EZD_BLENDS( p, x_col ) )
+						ezd_blend_span( p, &EZD_ROW( p, py )[ px * 4 ], 1, x_col );
+					else
+						*(unsigned int*)&EZD_ROW( p, py )[ px * 4 ] = x_col;
+					break;
+
+				case 4 :
+				case 8 :
+				case 16 :
+					ezd_span_v( p, EZD_ROW( p, py ), (int)px, 1, (unsigned int)c );
+					break;
+
+				default :
+					return 0;
+
+			} // end switch
+
+		} // end for
+
+		// Step
+		if ( 0 > d )
+			d += 2LL * cx + 3;
+		else
+			d += 2LL * ( cx - cy ) + 5, cy--;
+		cx++;
+
+	} // end while
+
+	return EZD_HAS_CALLBACK( p ) ? ezd_cb_flush( p ) : 1;
+}
+
+int ezd_circle( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col )
+{
+	return ezd_arc( x_hDib, x, y, x_rad, 0, EZD_PI2, x_col );
+}
+
+/// Returns floor( sqrt( n ) ) by Newton's method, s must not be less than the result
+static long long ezd_isqrt( long long n, long long s )
+{
+	long long t;
+
+	if ( 0 >= n || 0 >= s )
+		return 0;
+
+	while ( ( t = ( s + n / s ) >> 1 ) < s )
+		s = t;
+
+	return s;
+}
+
+int ezd_circle_aa( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col )
+{
+	int i, o, cx, cy, f, dx, dy, ok;
+	long long s, rr;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	if ( 0 > x_rad || 0x7fff < x_rad )
+		return _ERR( 0, "Invalid radius" );
+
+	// Skip circles entirely outside the clip rect
+	if ( (long long)x + x_rad + 1 < p->nClipLeft || (long long)x - x_rad - 1 >= p->nClipRight
+		 || (long long)y + x_rad + 1 < p->nClipTop || (long long)y - x_rad - 1 >= p->nClipBottom )
+		return 1;
+
+	ezd_dirty( p, (long long)x - x_rad - 1, (long long)y - x_rad - 1, (long long)x + x_rad + 2, (long long)y + x_rad + 2 );
+
+	// One octant, the distance from the center line is s / 256
+	rr = (long long)x_rad * x_rad << 16;
+	s = (long long)x_rad << 8;
+	for ( cx = 0; ; cx++ )
+	{
+		s = ezd_isqrt( rr - ( (long long)cx * cx << 16 ), s );
+		cy = (int)( s >> 8 ), f = (int)( s & 0xff );
+		if ( cx > cy )
+			break;
+
+		// Split each point between the two nearest pixels on the minor axis
+		for ( o = 0; o < 8; o++ )
+		{
+			// Don't blend pixels shared by two octants twice
+			if ( !cx && ( o & 1 ) )
+				continue;
+
+			for ( i = 0; i < 2; i++ )
+			{
+				if ( i ? !f : ( ( !cy && ( o & 2 ) ) || ( cx == cy && ( o & 4 ) ) ) )
+					continue;
+
+				dx = ( o & 1 ) ? -cx : cx;
+				dy = ( o & 2 ) ? -( cy + i ) : ( cy + i );
+				if ( o & 4 )
+					ok = ezd_aa_px( p, x + dy, y + dx, x_col, i ? f : 255 - f );
+				else
+					ok = ezd_aa_px( p, x + dx, y + dy, x_col, i ? f : 255 - f );
+				if ( !ok )
+					return 0;
+
+			} // end for
+
+		} // end for
+
+	} // end for
+
+	return EZD_HAS_CALLBACK( p ) ? ezd_cb_flush( p ) : 1;
+}
+
+/// Limits dx to the half line k * dx <= n
+static void ezd_half_span( long long k, long long n, long long *pLo, long long *pHi )
+{
+	long long q;
+
+	if ( !k )
+	{	if ( 0 > n )
+			*pLo = 1, *pHi = 0;
+		return;
+	} // end if
+
+	// Floor of n / |k|
+	q = ( 0 <= n ) ? n / EZD_ABS( k ) : -( ( -n + EZD_ABS( k ) - 1 ) / EZD_ABS( k ) );
+
+	if ( 0 < k )
+	{	if ( q < *pHi ) *pHi = q;
+	} // end if
+	else
+	{	if ( -q > *pLo ) *pLo = -q;
+	} // end else
+}
+
+/// Fills an ellipse, or the slice between two end point vectors
+/**
+	Each scan line's half width is found once with integer math, a
+	point is inside if x^2 / ( rx + 1/2 )^2 + y^2 / ( ry + 1/2 )^2 <= 1.
+	For slices, the end point tests are the same cross products
+	ezd_arc() uses, which reduce to half lines on each scan line.
+*/
+static int ezd_fill_slice( SImageData *p, int x, int y, int rx, int ry, int full,
+						   int sc, int ss, int ec, int es, int wide, int col )
+{
+	int i, dy, ly, n;
+	long long lo[ 2 ], hi[ 2 ], l, h;
+	unsigned long long A, B, AB, xw;
+
+	if ( 0 > rx || 0 > ry || 0x7fff < rx || 0x7fff < ry )
+		return _ERR( 0, "Invalid radius" );
+
+	// Skip shapes entirely outside the clip rect
+	if ( (long long)x + rx < p->nClipLeft || (long long)x - rx >= p->nClipRight
+		 || (long long)y + ry < p->nClipTop || (long long)y - ry >= p->nClipBottom )
+		return 1;
+
+	ezd_dirty( p, (long long)x - rx, (long long)y - ry, (long long)x + rx + 1, (long long)y + ry + 1 );
+
+	A = (unsigned long long)( 2 * rx + 1 ) * ( 2 * rx + 1 );
+	B = (unsigned long long)( 2 * ry + 1 ) * ( 2 * ry + 1 );
+	AB = A * B;
+
+	// Work outwards from the center line
+	xw = rx;
+	for ( dy = 0; dy <= ry; dy++ )
+	{
+		// Narrow to this line
+		while ( 4 * xw * xw * B + 4 * (unsigned long long)dy * dy * A > AB )
+			xw--;
+
+		// Lines above and below the center
+		for ( i = 0; i < 2; i++ )
+		{
+			ly = i ? y - dy : y + dy;
+			if ( ( i && !dy ) || ly < p->nClipTop || ly >= p->nClipBottom )
+				continue;
+
+			// Whole line
+			if ( full )
+			{	if ( !ezd_hline( p, x - (int)xw, x + (int)xw, ly, col ) )
+					return 0;
+				continue;
+			} // end if
+
+			// Start side, ss * dx <= sc * dy
+			lo[ 0 ] = -(long long)xw, hi[ 0 ] = xw;
+			ezd_half_span( ss, (long long)sc * ( ly - y ), &lo[ 0 ], &hi[ 0 ] );
+
+			// End side, -es * dx <= -ec * dy
+			if ( wide )
+				lo[ 1 ] = -(long long)xw, hi[ 1 ] = xw;
+			else
+				lo[ 1 ] = lo[ 0 ], hi[ 1 ] = hi[ 0 ];
+			ezd_half_span( -es, -(long long)ec * ( ly - y ), &lo[ 1 ], &hi[ 1 ] );
+
+			// Both sides for narrow slices, either side for wide ones
+			n = 1;
+			if ( wide )
+			{
+				if ( lo[ 0 ] > hi[ 0 ] )
+					lo[ 0 ] = lo[ 1 ], hi[ 0 ] = hi[ 1 ];
+
+				else if ( lo[ 1 ] <= hi[ 1 ] )
+				{
+					l = ( lo[ 0 ] > lo[ 1 ] ) ? lo[ 0 ] : lo[ 1 ];
+					h = ( hi[ 0 ] < hi[ 1 ] ) ? hi[ 0 ] : hi[ 1 ];
+
+					// Merge if they overlap or touch
+					if ( l <= h + 1 )
+					{	if ( lo[ 1 ] < lo[ 0 ] ) lo[ 0 ] = lo[ 1 ];
+						if ( hi[ 1 ] > hi[ 0 ] ) hi[ 0 ] = hi[ 1 ];
+					} // end if
+					else
+						n = 2;
+
+				} // end else if
+
+			} // end if
+			else
+				lo[ 0 ] = lo[ 1 ], hi[ 0 ] = hi[ 1 ];
+
+			while ( n-- )
+				if ( lo[ n ] <= hi[ n ] )
+					if ( !ezd_hline( p, x + (int)lo[ n ], x + (int)hi[ n ], ly, col ) )
+						return 0;
+
+		} // end for
+
+	} // end for
+
+	return EZD_HAS_CALLBACK( p ) ? ezd_cb_flush( p ) : 1;
+}
+
+int ezd_fill_ellipse( HEZDIMAGE x_hDib, int x, int y, int x_rx, int x_ry, int x_col )
+{
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	return ezd_fill_slice( p, x, y, x_rx, x_ry, 1, 0, 0, 0, 0, 0, x_col );
+}
+
+int ezd_fill_circle( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col )
+{
+	return ezd_fill_ellipse( x_hDib, x, y, x_rad, x_rad, x_col );
+}
+
+int ezd_fill_pie( HEZDIMAGE x_hDib, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col )
+{
+	int sc, ss, ec, es;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Dont' draw null slice
+	if ( x_dStart == x_dEnd )
+		return 1;
+
+	// Ensure correct order
+	else if ( x_dStart > x_dEnd )
+	{	double t = x_dStart;
+		x_dStart = x_dEnd;
+		x_dEnd = t;
+	} // end if
+
+	// Full circle?
+	if ( EZD_PI2 <= x_dEnd - x_dStart )
+		return ezd_fill_slice( p, x, y, x_rad, x_rad, 1, 0, 0, 0, 0, 0, x_col );
+
+	// End point vectors
+	ezd_sincos( x_dStart, &sc, &ss );
+	ezd_sincos( x_dEnd, &ec, &es );
+
+	return ezd_fill_slice( p, x, y, x_rad, x_rad, 0, sc, ss, ec, es,
+						   EZD_PI < x_dEnd - x_dStart, x_col );
+}
+
+/// Polygon edge state for ezd_fill_polygon()
+typedef struct _SPolyEdge
+{
+	/// Crossing at the current scan line center is x + r / d
+	long long		x, r, d;
+
+	/// Whole and remainder step per scan line
+	long long		sx, sr;
+
+	/// Last scan line, winding direction, next edge starting on the same line
+	int				y2, dir, next;
+
+	/// First pixel right of the crossing on the current line
+	long long		px;
+
+} SPolyEdge;
+
+int ezd_fill_polygon( HEZDIMAGE x_hDib, const int *x_pXy, int x_nPts, int x_col, int x_nRule )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	int i, j, n, y, y1, y2, ch, nActive, wind, *pHead, *pActive;
+	long long dx, dy, t;
+	SPolyEdge *pEdges, *e;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) || !x_pXy || 0 > x_nPts )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Nothing to fill
+	ch = p->nClipBottom - p->nClipTop;
+	if ( 3 > x_nPts || 0 >= ch || p->nClipLeft >= p->nClipRight )
+		return 1;
+
+	ezd_dirty_points( p, x_pXy, x_nPts );
+
+	// Edges, scan line buckets and the active list
+	pEdges = (SPolyEdge*)EZD_malloc( x_nPts * sizeof( SPolyEdge ) + ( ch + x_nPts ) * sizeof( int ) );
+	if ( !pEdges )
+		return _ERR( 0, "Out of memory" );
+	pHead = (int*)&pEdges[ x_nPts ];
+	pActive = &pHead[ ch ];
+
+	for ( y = 0; y < ch; y++ )
+		pHead[ y ] = -1;
+
+	// Build the edge table, a pixel is inside if its center is
+	for ( i = 0, n = 0; i < x_nPts; i++ )
+	{
+		const int *a = &x_pXy[ i * 2 ], *b = &x_pXy[ ( ( i + 1 ) % x_nPts ) * 2 ];
+
+		e = &pEdges[ n ];
+		e->dir = ( a[ 1 ] < b[ 1 ] ) ? 1 : -1;
+		if ( 0 > e->dir )
+		{	const int *t = a; a = b; b = t;
+		} // end if
+
+		// Scan lines a[ 1 ] .. b[ 1 ] - 1 within the clip rect
+		y1 = ( a[ 1 ] > p->nClipTop ) ? a[ 1 ] : p->nClipTop;
+		y2 = ( b[ 1 ] < p->nClipBottom ) ? b[ 1 ] : p->nClipBottom;
+		if ( y1 >= y2 )
+			continue;
+
+		// Crossing at the center of line y1, floor( ( 2 * ( y1 - ay ) + 1 ) * dx / d )
+		dx = (long long)b[ 0 ] - a[ 0 ];
+		dy = (long long)b[ 1 ] - a[ 1 ];
+		e->d = 2 * dy;
+		e->x = ezd_mul_div( EZD_ABS( dx ), 2 * ( (long long)y1 - a[ 1 ] ) + 1, e->d, &e->r );
+		if ( 0 > dx )
+		{	e->x = -e->x - ( e->r ? 1 : 0 );
+			e->r = e->r ? e->d - e->r : 0;
+		} // end if
+		e->x += a[ 0 ];
+
+		// Step per scan line
+		t = 2 * dx;
+		e->sx = ( 0 <= t ) ? t / e->d : -( ( -t + e->d - 1 ) / e->d );
+		e->sr = t - e->sx * e->d;
+
+		// Add to the bucket for its first line
+		e->y2 = y2;
+		e->next = pHead[ y1 - p->nClipTop ];
+		pHead[ y1 - p->nClipTop ] = n++;
+
+	} // end for
+
+	// Walk the scan lines
+	nActive = 0;
+	for ( y = p->nClipTop; y < p->nClipBottom; y++ )
+	{
+		// Add edges starting here
+		for ( i = pHead[ y - p->nClipTop ]; 0 <= i; i = pEdges[ i ].next )
+			pActive[ nActive++ ] = i;
+
+		if ( !nActive )
+			continue;
+
+		// Drop finished edges and find the first pixel right of each crossing
+		for ( i = 0, j = 0; i < nActive; i++ )
+		{	e = &pEdges[ pActive[ i ] ];
+			if ( y < e->y2 )
+			{	e->px = e->x + ( 2 * e->r > e->d );
+				pActive[ j++ ] = pActive[ i ];
+			} // end if
+		} // end for
+		nActive = j;
+
+		// Insertion sort, the order hardly changes between lines
+		for ( i = 1; i < nActive; i++ )
+		{	int k = pActive[ i ];
+			for ( j = i; 0 < j && pEdges[ pActive[ j - 1 ] ].px > pEdges[ k ].px; j-- )
+				pActive[ j ] = pActive[ j - 1 ];
+			pActive[ j ] = k;
+		} // end for
+
+		// Fill between crossings
+		for ( i = 0, wind = 0; i < nActive; i++ )
+		{
+			e = &pEdges[ pActive[ i ] ];
+
+			// Start of a run?
+			if ( !wind )
+				t = e->px;
+
+			if ( EZD_FILL_NONZERO == x_nRule )
+				wind += e->dir;
+			else
+				wind ^= 1;
+
+			// End of a run?
+			if ( !wind && t < e->px )
+			{
+				// Runs are clipped, but keep them in int range
+				long long l = ( t < p->nClipLeft ) ? p->nClipLeft : t;
+				long long r = ( e->px > p->nClipRight ) ? p->nClipRight : e->px;
+
+				if ( l < r && !ezd_hline( p, (int)l, (int)r - 1, y, x_col ) )
+				{	EZD_free( pEdges );
+					return 0;
+				} // end if
+
+			} // end if
+
+		} // end for
+
+		// Step to the next line
+		for ( i = 0; i < nActive; i++ )
+		{	e = &pEdges[ pActive[ i ] ];
+			e->x += e->sx, e->r += e->sr;
+			if ( e->r >= e->d )
+				e->x++, e->r -= e->d;
+		} // end for
+
+	} // end for
+
+	EZD_free( pEdges );
+
+	return EZD_HAS_CALLBACK( p ) ? ezd_cb_flush( p ) : 1;
+#endif
+}
+
+int ezd_fill_rect( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+{
+	int x, y, sw, pw, fw, fh;
+	unsigned char *pStart, *pPos;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
+		 || !EZD_CAN_DRAW( p ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	// Swap coords if needed
+	if ( x1 > x2 ) { int t = x1; x1 = x2; x2 = t; }
+	if ( y1 > y2 ) { int t = y1; y1 = y2; y2 = t; }
+
+	// Clip
+	if ( x1 < p->nClipLeft ) x1 = p->nClipLeft;
+	if ( y1 < p->nClipTop ) y1 = p->nClipTop;
+	if ( x2 > p->nClipRight ) x2 = p->nClipRight;
+	if ( y2 > p->nClipBottom ) y2 = p->nClipBottom;
+
+	// Fill width and height
+	fw = x2 - x1;
+	fh = y2 - y1;
+
+	// Is there anything left to fill?
+	if ( 0 >= fw || 0 >= fh )
+		return 1;
+
+	ezd_add_dirty( p, x1, y1, x2, y2 );
+
+	// Check for user callback function
+	if ( EZD_HAS_CALLBACK( p ) )
+	{
+		// Fill each line
+		for ( y = y1; y < y2; y++ )
+			if ( !ezd_cb_span( p, x1, y, fw, x_col, 0 ) )
+				return 0;
+
+		return ezd_cb_flush( p );
+
+	} // end if
+
+	// Composite each line
+	if ( 32 == p->bih.biBitCount && EZD_BLENDS( p, x_col ) )
+	{	for ( y = y1; y < y2; y++ )
+			ezd_blend_span( p, &EZD_ROW( p, y )[ x1 * 4 ], fw, x_col );
+		return 1;
+	} // end if
+
+	// Pixel and scan width
+	pw = p->nPixel;
+	sw = p->nStride;
+
+	// Set the first line
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+		{
+			int c = EZD_COMPARE_THRESHOLD( x_col, p->colThreshold );
+
+			// Fill each line a word at a time
+			for ( y = y1; y < y2; y++ )
+				ezd_span_1( EZD_ROW( p, y ), x1, fw, c );
+
+			return 1;
+
+		} break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+		{
+			unsigned int v = ezd_color_px( p, x_col );
+
+			for ( y = y1; y < y2; y++ )
+				ezd_span_v( p, EZD_ROW( p, y ), x1, fw, v );
+
+			return 1;
+
+		} break;
+
+		case 24 :
+		{
+			// Color values
+			unsigned char r = x_col & 0xff;
+			unsigned char g = ( x_col >> 8 ) & 0xff;
+			unsigned char b = ( x_col >> 16 ) & 0xff;
+			pStart = pPos = &EZD_ROW( p, y1 )[ x1 * pw ];
+
+			// Set the first line
+			for( x = 0; x < fw; x++, pPos += pw )
+				pPos[ 0 ] = r, pPos[ 1 ] = g, pPos[ 2 ] = b;
+
+		} break;
+
+		case 32 :
+		{
+			// Set the first line
+			pStart = pPos = &EZD_ROW( p, y1 )[ x1 * pw ];
+			for( x = 0; x < fw; x++, pPos += pw )
+				*(unsigned int*)pPos = x_col;
+
+		} break;
+
+		default :
+			return 0;
+
+	} // end switch
+
+	// Copy remaining lines
+	pPos = pStart;
+	for( y = 1; y < fh; y++ )
+	{
+		// Skip to next line
+		pPos += sw;
+		EZD_MEMCPY( pPos, pStart, fw * pw );
+
+	} // end for
+
+	return 1;
+}
+
+#if !defined( EZD_NO_ALLOCATION )
+
+/// Colors for the flood fill pixel tests
+typedef struct _SFillCols
+{
+	/// Fill and border colors
+	int					col, bcol;
+
+	/// Fill and border pixel values for 1, 4, 8 and 16 bit images
+	unsigned int		c, bc;
+
+	/// 24 bit components
+	unsigned char		r, g, b, br, bg, bb;
+
+} SFillCols;
+
+/// Steps x by d until the pixel's fillable state differs from want, or x reaches end
+/**
+	A pixel is fillable if it is neither the fill nor the border color.
+	For 1 bit images, any pixel not already the fill value is fillable.
+*/
+static int ezd_fill_scan( SImageData *p, const unsigned char *pLine, int x, int end, int d,
+						  int want, const SFillCols *f )
+{
+	switch( p->bih.biBitCount )
+	{
+		case 1 :
+			for ( ; x != end; x += d )
+				if ( ( ( ( pLine[ x >> 3 ] >> ( 7 - ( x & 7 ) ) ) & 1 ) != f->c ) != want )
+					break;
+			break;
+
+		case 4 :
+		case 8 :
+		case 16 :
+			for ( ; x != end; x += d )
+			{	unsigned int v = ezd_get_v( p, pLine, x );
+				if ( ( v != f->c && v != f->bc ) != want )
+					break;
+			} // end for
+			break;
+
+		case 24 :
+			for ( ; x != end; x += d )
+			{	const unsigned char *s = &pLine[ x * 3 ];
+				if ( ( ( s[ 0 ] != f->r || s[ 1 ] != f->g || s[ 2 ] != f->b )
+					   && ( s[ 0 ] != f->br || s[ 1 ] != f->bg || s[ 2 ] != f->bb ) ) != want )
+					break;
+			} // end for
+			break;
+
+		case 32 :
+			for ( ; x != end; x += d )
+			{	unsigned int v = *(const unsigned int*)&pLine[ x * 4 ];
+				if ( ( v != (unsigned int)f->col && v != (unsigned int)f->bcol ) != want )
+					break;
+			} // end for
+			break;
+
+	} // end switch
+
+	return x;
+}
+
+/// Pushes a flood fill segment, growing the image's fill stack if needed
+static int ezd_fill_push( SImageData *p, int *pn, int y, int xl, int xr, int dy )
+{
+	SFillSeg *s;
+
+	// Skip lines outside the clip rect
+	if ( y + dy < p->nClipTop || y + dy >= p->nClipBottom )
+		return 1;
+
+	// Grow the stack
+	if ( *pn >= p->nFillStack )
+	{
+		int n = p->nFillStack ? p->nFillStack * 2 : 256;
+		SFillSeg *pNew = (SFillSeg*)EZD_malloc( n * sizeof( SFillSeg ) );
+		if ( !pNew )
+			return _ERR( 0, "Out of memory" );
+
+		if ( p->pFillStack )
+		{	EZD_MEMCPY( (char*)pNew, (const char*)p->pFillStack, *pn * sizeof( SFillSeg ) );
+			EZD_free( p->pFillStack );
+		} // end if
+
+		p->pFillStack = pNew;
+		p->nFillStack = n;
+
+	} // end if
+
+	s = &p->pFillStack[ ( *pn )++ ];
+	s->y = y, s->xl = xl, s->xr = xr, s->dy = dy;
+
+	return 1;
+}
+
+/// Flood fills from a seed inside the clip rect
+static int ezd_flood( SImageData *p, int x, int y, int x_bcol, int x_col )
+{
+	int n, x1, x2, dy, l, r;
+	unsigned char *pLine;
+	SFillCols f;
+
+	// Prepare colors
+	f.col = x_col, f.bcol = x_bcol;
+	f.c = ezd_color_px( p, x_col ), f.bc = ezd_color_px( p, x_bcol );
+	f.r = x_col & 0xff; f.g = ( x_col >> 8 ) & 0xff; f.b = ( x_col >> 16 ) & 0xff;
+	f.br = x_bcol & 0xff; f.bg = ( x_bcol >> 8 ) & 0xff; f.bb = ( x_bcol >> 16 ) & 0xff;
+
+	// Nothing to do if the seed isn't fillable
+	if ( ezd_fill_scan( p, EZD_ROW( p, y ), x, x + 1, 1, 1, &f ) == x )
+		return 1;
+
+	// Seed segment, lines are stored before stepping by dy
+	n = 0;
+	if ( !ezd_fill_push( p, &n, y, x, x, 1 ) || !ezd_fill_push( p, &n, y + 1, x, x, -1 ) )
+		return 0;
+
+	// Fill one run at a time, only the runs' edges are ever on the stack
+	while ( n )
+	{
+		n--;
+		dy = p->pFillStack[ n ].dy;
+		y = p->pFillStack[ n ].y + dy;
+		x1 = p->pFillStack[ n ].xl;
+		x2 = p->pFillStack[ n ].xr;
+		pLine = EZD_ROW( p, y );
+
+		// Does the run extend left of the parent?
+		l = ezd_fill_scan( p, pLine, x1, p->nClipLeft - 1, -1, 1, &f ) + 1;
+		if ( l <= x1 )
+		{
+			// Leak back around the left end
+			if ( l < x1 && !ezd_fill_push( p, &n, y, l, x1 - 1, -dy ) )
+				return 0;
+			x = x1;
+		} // end if
+
+		// Find the first fillable pixel under the parent
+		else
+		{	x = ezd_fill_scan( p, pLine, x1 + 1, x2 + 1, 1, 0, &f );
+			l = x;
+		} // end else
+
+		while ( x <= x2 )
+		{
+			// Find the end of this run and fill it, blending would leave it fillable
+			r = ezd_fill_scan( p, pLine, x, p->nClipRight, 1, 1, &f ) - 1;
+			if ( 1 == p->bih.biBitCount )
+				ezd_span_1( pLine, l, r - l + 1, f.c );
+			else if ( 24 > p->bih.biBitCount )
+				ezd_span_v( p, pLine, l, r - l + 1, f.c );
+			else
+				ezd_span_px( pLine, l, r - l + 1, p->nPixel, x_col );
+			ezd_add_dirty( p, l, y, r + 1, y + 1 );
+
+			// Continue in the same direction
+			if ( !ezd_fill_push( p, &n, y, l, r, dy ) )
+				return 0;
+
+			// Leak back around the right end
+			if ( r > x2 && !ezd_fill_push( p, &n, y, x2 + 1, r, -dy ) )
+				return 0;
+
+			// Next run under the parent
+			x = r + 2;
+			if ( x <= x2 )
+				x = ezd_fill_scan( p, pLine, x, x2 + 1, 1, 0, &f );
+			l = x;
+
+		} // end while
+
+	} // end while
+
+	return 1;
+}
+
+#endif
+
+int ezd_flood_fill( HEZDIMAGE x_hDib, int x, int y, int x_bcol, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	int ok;
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !p->pImage
+		 || ( EZD_FLAG_READ_ONLY & p->uFlags ) )
+		return _ERR( 0, "Invalid parameters" );
+
+	if ( !EZD_VALID_BPP( p->bih.biBitCount ) )
+		return _ERR( 0, "Invalid pixel depth" );
+
+	// Ensure pixel is within the image
+	if ( 0 > x || x >= p->nWidth || 0 > y || y >= p->nHeight )
+	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, p->nWidth, p->nHeight );
+		return 0;
+	} // en dif
+
+	// Nothing to do if the seed is clipped
+	if ( !EZD_IN_CLIP( p, x, y ) )
+		return 1;
+
+	ok = ezd_flood( p, x, y, x_bcol, x_col );
+
+	// Only headers from ezd_create() keep the stack for the next fill,
+	// ezd_initialize() headers may never be passed to ezd_destroy()
+	if ( !( EZD_FLAG_FREE_BUFFER & p->uFlags ) && p->pFillStack )
+		EZD_free( p->pFillStack ), p->pFillStack = 0, p->nFillStack = 0;
+
+	return ok;
+#endif
+}
+
+static int ezd_draw_bmp_cb( SImageData *p, int x, int y, int bw, int bh,
+							const unsigned char *pBmp, int col, int ch )
+{
+	int w, h, run, pos = 0;
+
+	// Draw the glyph
+	for( h = 0; h < bh; h++, y++ )
+	{
+		// Pass each run of set pixels as a span
+		for( w = 0, run = 0; w < bw; w++, pos++ )
+			if ( pBmp[ pos >> 3 ] & ( 0x80 >> ( pos & 7 ) ) )
+				run++;
+			else if ( run )
+			{	if ( !ezd_cb_span( p, x + w - run, y, run, col, ch ) )
+					return 0;
+				run = 0;
+			} // end else if
+
+		// Run at the end of the line
+		if ( run && !ezd_cb_span( p, x + bw - run, y, run, col, ch ) )
+			return 0;
+
+	} // end for
+
+	return 1;
+}
+
+static void ezd_draw_bmp( SImageData *p, int x, int y, int inv,
+						  int bw, int bh, const unsigned char *pBmp, int col )
+{
+	int i, n, lx, ly, nb, c;
+	unsigned char *pLine;
+	unsigned long long v;
+
+	// Pixel value for 1, 4, 8 and 16 bit images
+	c = (int)ezd_color_px( p, col );
+
+	// Draw the glyph a row at a time
+	for( i = 0; i < bh; i++ )
+	{
+		// Skip lines outside the clip rect
+		ly = y + i * inv;
+		if ( ly < p->nClipTop || ly >= p->nClipBottom )
+			continue;
+
+		pLine = EZD_ROW( p, ly );
+
+		// Up to 56 glyph bits at a time
+		for ( n = 0; n < bw; n += 56 )
+		{
+			lx = x + n;
+			nb = ( bw - n > 56 ) ? 56 : ( bw - n );
+			v = ezd_get_bits( pBmp, i * bw + n, nb );
+
+			// Clip left
+			if ( lx < p->nClipLeft )
+			{	if ( p->nClipLeft - lx >= nb )
+					continue;
+				v <<= p->nClipLeft - lx, nb -= p->nClipLeft - lx, lx = p->nClipLeft;
+			} // end if
+
+			// Clip right
+			if ( lx + nb > p->nClipRight )
+				nb = p->nClipRight - lx;
+
+			if ( 0 >= nb )
+				continue;
+
+			// Drop bits past the clip rect
+			v &= ~( ~(unsigned long long)0 >> nb );
+
+			switch( p->bih.biBitCount )
+			{
+				case 1 :
+					ezd_bits_1( pLine, lx, v, nb, c );
+					break;
+
+				case 24 :
+				{
+					unsigned char *pPos;
+					for ( ; v; v <<= 1, lx++ )
+						if ( v >> 63 )
+						{	pPos = &pLine[ lx * 3 ];
+							pPos[ 0 ] = col & 0xff;
+							pPos[ 1 ] = ( col >> 8 ) & 0xff;
+							pPos[ 2 ] = ( col >> 16 ) & 0xff;
+						} // end if
+				} break;
+
+				case 32 :
+					if ( EZD_BLENDS( p, col ) )
+						for ( ; v; v <<= 1, lx++ )
+						{	if ( v >> 63 )
+								ezd_blend_span( p, &pLine[ lx * 4 ], 1, col );
+						} // end for
+					else
+						for ( ; v; v <<= 1, lx++ )
+							if ( v >> 63 )
+								*(unsigned int*)&pLine[ lx * 4 ] = col;
+					break;
+
+				case 4 :
+				case 8 :
+				case 16 :
+					for ( ; v; v <<= 1, lx++ )
+						if ( v >> 63 )
+							ezd_span_v( p, pLine, lx, 1, (unsigned int)c );
+					break;
+
+			} // end switch
+
+		} // end for
+
+	} // end for
+
+}
+
+int ezd_text(HEZDIMAGE x_hDib, HEZDFONT x_hFont, const char *x_pText, int x_nTextLen, int x, int y, int x_col)
+{
+	int w, h, inv, i, mh = 0, lx = x;
+	const tGlyph *_pGlyph;
+	SImageData *p = (SImageData*)x_hDib;
+
+#if !defined( EZD_STATIC_FONTS )
+	SFontData *f = (SFontData*)x_hFont;
+	if (!f)
+		return _ERR(0, "Invalid parameters");
+#endif
+
+	// Sanity checks
+	if (!p || sizeof(SBitmapInfoHeader) != p->bih.biSize
+		|| !EZD_CAN_DRAW(p))
+		return _ERR(0, "Invalid parameters");
+
+	// Image metrics
+	w = p->nWidth;
+	h = p->nHeight;
+
+	// Invert font?
+	inv = ((0 < p->bih.biHeight ? 1 : 0)
+#if !defined( EZD_STATIC_FONTS )
+		^ ((f->uFlags & EZD_FONT_FLAG_INVERT) ? 1 : 0)
+#endif
+		) ? -1 : 1;
+
+	// For each character in the string
+	for (i = 0; i < x_nTextLen || (0 > x_nTextLen && x_pText[i]); i++)
+	{
+		// Get the specified glyph
+		_pGlyph = ezd_find_glyph(x_hFont, x_pText[i]);
+
+		// CR, just go back to starting x pos
+		if ('\r' == x_pText[i])
+			lx = x;
+
+		// LF - Back to starting x and next line
+		else if ('\n' == x_pText[i])
+			lx = x, y += inv * (1 + mh), mh = 0;
+
+		// Other characters
+		else
 		{
-			if ( x1 == x2 && y1 == y2 )
-				done = 1;
+			int gWidth = (int)(_pGlyph->bbox.width) + (int)(_pGlyph->bbox.xoffset);
+			int gHeight = (int)(_pGlyph->bbox.height) + (int)(_pGlyph->bbox.yoffset);
+			int baselineAKAOriginY = (int)(f->bbox.height) + (int)(f->bbox.yoffset);
+			int bitmapTop = baselineAKAOriginY - gHeight;
+			_SHOW("Glyph '%c' (w,h):%d,%d bl:%d top:%d\n", _pGlyph->encoding, gWidth, gHeight, baselineAKAOriginY, bitmapTop);
+			// Draw this glyph if it's completely on the screen
+			// Let user callbacks draw outside
+			if ((gWidth && gHeight) && (EZD_HAS_CALLBACK(p) ||
+				(0 <= lx && (lx + gWidth) < w
+				&& 0 <= y && (y + f->bbox.height) <= h)))
+			{
+				int originX = lx + (int)(_pGlyph->bbox.xoffset);
+				int originY = y + bitmapTop;
+				// Callbacks get the glyph top down
+				int dirtyY = (EZD_HAS_CALLBACK(p) || 0 < inv) ? originY : originY - _pGlyph->bbox.height + 1;
+				ezd_dirty(p, originX, dirtyY, originX + (long long)_pGlyph->bbox.width, dirtyY + (long long)_pGlyph->bbox.height);
+				// Check for user callback function
+				if (EZD_HAS_CALLBACK(p))
+				{
+					if (!ezd_draw_bmp_cb(p, originX, originY,
+						_pGlyph->bbox.width, _pGlyph->bbox.height, (const unsigned char*)(_pGlyph + 1), // -> not pointing to next glyph but the data
+						x_col, x_pText[i]))
+						return 0;
+				}
+
+				else
+					ezd_draw_bmp(p, originX, originY, inv,
+						_pGlyph->bbox.width, _pGlyph->bbox.height, (const unsigned char*)(_pGlyph + 1), // -> not pointing to next glyph but the data
+						x_col);
+
+			} // end if
+
+			  // Next character position
+			lx += f->spacing + _pGlyph->xoffsetnext;
+
+			// Track max height
+			mh = (gHeight > mh) ? gHeight : mh;
+
+		} // end else
+
+	} // end for
+
+	// Pass on any queued pixels
+	if (EZD_HAS_CALLBACK(p))
+		return ezd_cb_flush(p);
+
+	return 1;
+}
+
+//------------------------------------------------------------------
+// Threaded rendering
+//------------------------------------------------------------------
+#if !defined( EZD_NO_THREADS )
+
+#	if defined( _WIN32 )
+#		define EZD_LOCK( m )		EnterCriticalSection( m )
+#		define EZD_UNLOCK( m )		LeaveCriticalSection( m )
+#		define EZD_LOCK_INIT( m )	InitializeCriticalSection( m )
+#		define EZD_LOCK_FREE( m )	DeleteCriticalSection( m )
+		typedef CRITICAL_SECTION t_ezd_mutex;
+#	else
+#		define EZD_LOCK( m )		pthread_mutex_lock( m )
+#		define EZD_UNLOCK( m )		pthread_mutex_unlock( m )
+#		define EZD_LOCK_INIT( m )	pthread_mutex_init( m, 0 )
+#		define EZD_LOCK_FREE( m )	pthread_mutex_destroy( m )
+		typedef pthread_mutex_t t_ezd_mutex;
+#	endif
+
+#else
+
+	// Everything runs on the calling thread
+#	define EZD_LOCK( m )
+#	define EZD_UNLOCK( m )
+#	define EZD_LOCK_INIT( m )
+#	define EZD_LOCK_FREE( m )
+	typedef int t_ezd_mutex;
+
+#endif
+
+/// Work function for ezd_run_threads()
+typedef void (*t_ezd_work)( void *pJob );
+
+#if !defined( EZD_NO_THREADS )
+
+/// What a thread started by ezd_run_threads() runs
+typedef struct _SThreadStart
+{
+	/// Work function
+	t_ezd_work			pfWork;
+
+	/// Data passed to pfWork
+	void				*pJob;
+
+} SThreadStart;
+
+#	if defined( _WIN32 )
+static DWORD WINAPI ezd_thread( LPVOID pStart )
+{
+	( (SThreadStart*)pStart )->pfWork( ( (SThreadStart*)pStart )->pJob );
+	return 0;
+}
+#	else
+static void* ezd_thread( void *pStart )
+{
+	( (SThreadStart*)pStart )->pfWork( ( (SThreadStart*)pStart )->pJob );
+	return 0;
+}
+#	endif
+
+#endif
+
+/// Runs pfWork on nThreads threads, this one included, and waits for them all
+static void ezd_run_threads( t_ezd_work pfWork, void *pJob, int nThreads )
+{
+#if !defined( EZD_NO_THREADS )
+	int i, n = 0;
+	SThreadStart s;
+#	if defined( _WIN32 )
+	HANDLE th[ EZD_MAX_THREADS ];
+#	else
+	pthread_t th[ EZD_MAX_THREADS ];
+#	endif
+
+	s.pfWork = pfWork, s.pJob = pJob;
+
+	if ( nThreads > EZD_MAX_THREADS )
+		nThreads = EZD_MAX_THREADS;
+
+#	if defined( _WIN32 )
+	for ( i = 1; i < nThreads; i++ )
+		if ( 0 != ( th[ n ] = CreateThread( 0, 0, ezd_thread, &s, 0, 0 ) ) )
+			n++;
+#	else
+	for ( i = 1; i < nThreads; i++ )
+		if ( !pthread_create( &th[ n ], 0, ezd_thread, &s ) )
+			n++;
+#	endif
+#endif
+
+	// This thread works too, and does everything if no threads started
+	pfWork( pJob );
+
+#if !defined( EZD_NO_THREADS )
+#	if defined( _WIN32 )
+	for ( i = 0; i < n; i++ )
+		WaitForSingleObject( th[ i ], INFINITE ), CloseHandle( th[ i ] );
+#	else
+	for ( i = 0; i < n; i++ )
+		pthread_join( th[ i ], 0 );
+#	endif
+#endif
+}
+
+/// Returns the number of processors
+static int ezd_cpu_count()
+{
+#	if defined( EZD_NO_THREADS )
+	return 1;
+#	elif defined( _WIN32 )
+	SYSTEM_INFO si;
+	GetSystemInfo( &si );
+	return (int)si.dwNumberOfProcessors;
+#	elif defined( _SC_NPROCESSORS_ONLN )
+	return (int)sysconf( _SC_NPROCESSORS_ONLN );
+#	else
+	return 1;
+#	endif
+}
+
+#if !defined( EZD_NO_THREADS )
+
+/// Work shared by the ezd_render_threads() threads
+typedef struct _SBandJob
+{
+	/// Image being drawn
+	SImageData			*p;
+
+	/// Draw function and user data
+	t_ezd_draw			pfDraw;
+	void				*pUser;
+
+	/// Rows in memory, rows per band, and number of bands
+	int					nTop;
+	int					nEnd;
+	int					nRows;
+	int					nBands;
+
+	/// Next band to draw, guarded by lock
+	int					nNext;
+
+	/// Zero once a draw fails
+	int					ok;
+
+	/// Box around each band's dirty rects, merged in band order when done
+	int					rcDirty[ EZD_MAX_THREADS * 4 ][ 4 ];
+
+	/// Guards nNext and ok
+	t_ezd_mutex			lock;
+
+} SBandJob;
+
+/// Draws bands until there are none left
+static void ezd_band_worker( void *pJob )
+{
+	int b, y, n, ok, i, k;
+	SBandJob *j = (SBandJob*)pJob;
+	SImageData d, *p = j->p;
+
+	for ( ; ; )
+	{
+		// Take the next band
+		EZD_LOCK( &j->lock );
+		b = j->ok ? j->nNext++ : j->nBands;
+		EZD_UNLOCK( &j->lock );
+
+		if ( b >= j->nBands )
+			return;
+
+		y = j->nTop + b * j->nRows;
+		n = ( j->nEnd - y < j->nRows ) ? j->nEnd - y : j->nRows;
+
+		// A copy of the header that only sees this band, pBuffer may
+		// hold pixels other threads are drawing
+		EZD_MEMCPY( (char*)&d, (const char*)p, (int)( (char*)p->pBuffer - (char*)p ) );
+		d.pImage = &p->pImage[ ( y - j->nTop ) * p->nStride ];
+		d.nBandTop = y, d.nBandRows = n;
+		d.pFillStack = 0, d.nFillStack = 0;
+		d.nDirty = 0;
+		if ( d.nClipTop < y ) d.nClipTop = y;
+		if ( d.nClipBottom > y + n ) d.nClipBottom = y + n;
+
+		// Nothing to draw if the clip rect misses the band
+		j->rcDirty[ b ][ 0 ] = j->rcDirty[ b ][ 2 ] = 0;
+		if ( d.nClipTop >= d.nClipBottom )
+			continue;
+
+		ok = j->pfDraw( j->pUser, (HEZDIMAGE)&d );
+
+		// Box around what the band drew
+		for ( i = 0; i < d.nDirty; i++ )
+			for ( k = 0; k < 4; k++ )
+				if ( !i || ( ( k < 2 ) ? d.rcDirty[ i ][ k ] < j->rcDirty[ b ][ k ]
+									   : d.rcDirty[ i ][ k ] > j->rcDirty[ b ][ k ] ) )
+					j->rcDirty[ b ][ k ] = d.rcDirty[ i ][ k ];
+
+#if !defined( EZD_NO_ALLOCATION )
+		if ( d.pFillStack )
+			EZD_free( d.pFillStack );
+#endif
+
+		if ( !ok )
+		{	EZD_LOCK( &j->lock );
+			j->ok = 0;
+			EZD_UNLOCK( &j->lock );
+		} // end if
+
+	} // end for
+}
+
+#endif
+
+int ezd_render_threads( HEZDIMAGE x_hDib, int x_nThreads, t_ezd_draw x_pfDraw, void *x_pUser )
+{
+	SImageData *p = (SImageData*)x_hDib;
+
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !x_pfDraw )
+		return _ERR( 0, "Invalid parameters" );
+
+#if defined( EZD_NO_THREADS )
+
+	return x_pfDraw( x_pUser, x_hDib );
+
+#else
+{
+	int i, h;
+	SBandJob j;
+
+	// Rows in memory
+	h = p->nBandRows ? p->nBandRows : p->nHeight;
+
+	if ( 0 >= x_nThreads )
+		x_nThreads = ezd_cpu_count();
+	if ( x_nThreads > EZD_MAX_THREADS )
+		x_nThreads = EZD_MAX_THREADS;
+	if ( x_nThreads > h )
+		x_nThreads = h;
+
+	// Callbacks are not thread safe, and one thread needs no bands
+	if ( 1 >= x_nThreads || !p->pImage || EZD_HAS_CALLBACK( p ) )
+		return x_pfDraw( x_pUser, x_hDib );
+
+	// A few bands per thread evens out frames with more detail in places
+	j.p = p, j.pfDraw = x_pfDraw, j.pUser = x_pUser;
+	j.nTop = p->nBandTop, j.nEnd = p->nBandTop + h;
+	j.nBands = ( h < x_nThreads * 4 ) ? h : x_nThreads * 4;
+	j.nRows = ( h + j.nBands - 1 ) / j.nBands;
+	j.nBands = ( h + j.nRows - 1 ) / j.nRows;
+	j.nNext = 0, j.ok = 1;
+
+	// Pick the fill kernels before the threads race to do it
+	ezd_get_fill_pattern();
+	ezd_get_blend_fill();
+	ezd_get_blend_copy();
+
+	EZD_LOCK_INIT( &j.lock );
+	ezd_run_threads( ezd_band_worker, &j, x_nThreads );
+	EZD_LOCK_FREE( &j.lock );
+
+	// Same dirty rects whichever thread drew each band
+	for ( i = 0; i < j.nBands && i < j.nNext; i++ )
+		if ( j.rcDirty[ i ][ 0 ] < j.rcDirty[ i ][ 2 ] )
+			ezd_add_dirty( p, j.rcDirty[ i ][ 0 ], j.rcDirty[ i ][ 1 ], j.rcDirty[ i ][ 2 ], j.rcDirty[ i ][ 3 ] );
+
+	return j.ok;
+}
+#endif
+}
+
+//------------------------------------------------------------------
+// PNG output
+//------------------------------------------------------------------
+#if !defined( EZD_NO_ALLOCATION )
+
+/// Bytes of filtered rows compressed together, each chunk is compressed on its own
+#define EZD_PNG_CHUNK		( 256 * 1024 )
+
+/// Size of the match finder hash table, in bits
+#define EZD_PNG_HASH_BITS	14
+
+/// Reads four bytes for the match finder
+#define EZD_PNG_GET32( p ) ( (unsigned int)(p)[ 0 ] | ( (unsigned int)(p)[ 1 ] << 8 ) \
+							 | ( (unsigned int)(p)[ 2 ] << 16 ) | ( (unsigned int)(p)[ 3 ] << 24 ) )
+
+/// Deflate length code bases and extra bits
+static const unsigned short ezd_len_base[ 29 ] =
+	{ 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char ezd_len_extra[ 29 ] =
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+
+/// Deflate distance code bases and extra bits
+static const unsigned short ezd_dist_base[ 30 ] =
+	{ 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385,
+	  513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char ezd_dist_extra[ 30 ] =
+	{ 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+/// Tables built by ezd_png_init()
+static struct
+{
+	/// Non-zero once built
+	int				bInit;
+
+	/// CRC-32 of each byte
+	unsigned int	uCrc[ 256 ];
+
+	/// Fixed Huffman literal / length codes, bit reversed, with the code length in the top byte
+	unsigned int	uLit[ 288 ];
+
+	/// Code and extra bits for each match length from 3 to 258, with the total length in the top byte
+	unsigned int	uLen[ 256 ];
+
+	/// Distance codes for distances up to 256, and above that by 128
+	unsigned char	uDist[ 2 ][ 256 ];
+
+} g_ezd_png;
+
+/// Reverses the order of the low n bits of v
+static unsigned int ezd_reverse_bits( unsigned int v, int n )
+{
+	unsigned int r = 0;
+	while ( n-- )
+		r = ( r << 1 ) | ( v & 1 ), v >>= 1;
+	return r;
+}
 
-			// Plot pixel
-			if ( 0 <= x1 && x1 < w && 0 <= y1 && y1 < h )
-				if ( !p->pfSetPixel( p->pSetPixelUser, x1, y1, x_col, 0 ) )
-					return 0;
+/// Builds the CRC and fixed Huffman tables
+static void ezd_png_init()
+{
+	int i, k, n, c;
+	unsigned int u;
 
-			mx += xl;
-			if ( x1 != x2 && mx > yl )
-				x1 += xd, mx -= yl;
+	if ( g_ezd_png.bInit )
+		return;
 
-			my += yl;
-			if ( y1 != y2 && my > xl )
-				y1 += yd, my -= xl;
+	for ( i = 0; i < 256; i++ )
+	{	for ( u = (unsigned int)i, k = 0; k < 8; k++ )
+			u = ( u & 1 ) ? 0xedb88320 ^ ( u >> 1 ) : u >> 1;
+		g_ezd_png.uCrc[ i ] = u;
+	} // end for
 
-		} // end while
+	for ( i = 0; i < 288; i++ )
+	{	if ( 144 > i ) c = 0x30 + i, n = 8;
+		else if ( 256 > i ) c = 0x190 + i - 144, n = 9;
+		else if ( 280 > i ) c = i - 256, n = 7;
+		else c = 0xc0 + i - 280, n = 8;
+		g_ezd_png.uLit[ i ] = ezd_reverse_bits( c, n ) | ( n << 24 );
+	} // end for
 
-		return 1;
+	// Extra bits go after the code, 258 has its own code
+	for ( i = 0; i < 29; i++ )
+		for ( k = 0; k < ( 1 << ezd_len_extra[ i ] ) && 258 >= ezd_len_base[ i ] + k; k++ )
+		{	u = g_ezd_png.uLit[ 257 + i ];
+			n = ( u >> 24 ) + ezd_len_extra[ i ];
+			g_ezd_png.uLen[ ezd_len_base[ i ] + k - 3 ] = ( u & 0xffffff ) | ( k << ( u >> 24 ) ) | ( n << 24 );
+		} // end for
 
-	} // end if
+	for ( i = 0; i < 30; i++ )
+		for ( k = 0; k < ( 1 << ezd_dist_extra[ i ] ); k++ )
+			if ( 256 >= ezd_dist_base[ i ] + k )
+				g_ezd_png.uDist[ 0 ][ ezd_dist_base[ i ] + k - 1 ] = (unsigned char)i;
+			else
+				g_ezd_png.uDist[ 1 ][ ( ezd_dist_base[ i ] + k - 1 ) >> 7 ] = (unsigned char)i;
 
-	// Pixel and scan width
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 4 );
+	g_ezd_png.bInit = 1;
+}
 
-	// Set the first line
-	switch( p->bih.biBitCount )
-	{
-		case 1 :
-		{
-			int mx = 0, my = 0, c = EZD_COMPARE_THRESHOLD( x_col, p->colThreshold );
-			static unsigned char xm[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+/// Adds n bytes to a CRC-32
+static unsigned int ezd_crc32( unsigned int crc, const unsigned char *p, int n )
+{
+	crc = ~crc;
+	while ( 0 < n-- )
+		crc = g_ezd_png.uCrc[ ( crc ^ *p++ ) & 0xff ] ^ ( crc >> 8 );
+	return ~crc;
+}
 
-			// Draw the line
-			while ( !done )
-			{
-				if ( x1 == x2 && y1 == y2 )
-					done = 1;
+/// Adds n bytes to an Adler-32
+static unsigned int ezd_adler32( unsigned int adler, const unsigned char *p, int n )
+{
+	int k;
+	unsigned int a = adler & 0xffff, b = adler >> 16;
+
+	// 5552 bytes is as many as can be summed before the sums overflow
+	while ( 0 < n )
+	{	k = ( 5552 < n ) ? 5552 : n;
+		n -= k;
+		while ( k-- )
+			a += *p++, b += a;
+		a %= 65521, b %= 65521;
+	} // end while
+
+	return a | ( b << 16 );
+}
 
-				// Plot pixel
-				if ( 0 <= x1 && x1 < w && 0 <= y1 && y1 < h )
-				{
-					if ( c )
-						p->pImage[ y1 * sw + ( x1 >> 3 ) ] |= xm[ x1 & 7 ];
-					else
-						p->pImage[ y1 * sw + ( x1 >> 3 ) ] &= ~xm[ x1 & 7 ];
+/// Returns the Adler-32 of two blocks from the Adler-32 of each, n2 is the size of the second
+static unsigned int ezd_adler32_combine( unsigned int a1, unsigned int a2, int n2 )
+{
+	unsigned int rem = (unsigned int)n2 % 65521;
+	unsigned int s1 = a1 & 0xffff, s2 = ( rem * s1 ) % 65521;
 
-				} // end if
+	s1 = ( s1 + ( a2 & 0xffff ) + 65521 - 1 ) % 65521;
+	s2 = ( s2 + ( a1 >> 16 ) + ( a2 >> 16 ) + 65521 - rem ) % 65521;
 
-				mx += xl;
-				if ( x1 != x2 && mx > yl )
-					x1 += xd, mx -= yl;
+	return s1 | ( s2 << 16 );
+}
 
-				my += yl;
-				if ( y1 != y2 && my > xl )
-					y1 += yd, my -= xl;
+/// Writes a 32 bit big endian value
+static void ezd_put_be32( unsigned char *p, unsigned int v )
+{
+	p[ 0 ] = (unsigned char)( v >> 24 ), p[ 1 ] = (unsigned char)( v >> 16 );
+	p[ 2 ] = (unsigned char)( v >> 8 ), p[ 3 ] = (unsigned char)v;
+}
 
-			} // end while
+/// Deflate bit stream
+typedef struct _SBitOut
+{
+	/// Next byte to write
+	unsigned char		*pOut;
 
-		} break;
+	/// Bits not yet written, and how many
+	unsigned long long	uBits;
+	int					nBits;
 
-		case 24 :
-		{
-			// Color values
-			unsigned char r = x_col & 0xff;
-			unsigned char g = ( x_col >> 8 ) & 0xff;
-			unsigned char b = ( x_col >> 16 ) & 0xff;
-			unsigned char *pImg;
-			int mx = 0, my = 0;
+} SBitOut;
 
-			while ( !done )
-			{
-				if ( x1 == x2 && y1 == y2 )
-					done = 1;
+/// Writes the low n bits of v
+static void ezd_put_bits( SBitOut *o, unsigned int v, int n )
+{
+	o->uBits |= (unsigned long long)v << o->nBits;
+	o->nBits += n;
+	while ( 8 <= o->nBits )
+		*o->pOut++ = (unsigned char)o->uBits, o->uBits >>= 8, o->nBits -= 8;
+}
 
-				// Plot pixel
-				if ( 0 <= x1 && x1 < w && 0 <= y1 && y1 < h )
-				{	pImg = &p->pImage[ y1 * sw + x1 * pw ];
-					pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
-				} // end if
+/// Writes a literal or length symbol
+#define EZD_PUT_CODE( o, c ) ezd_put_bits( o, ( c ) & 0xffffff, ( c ) >> 24 )
+
+/// Compresses n bytes as deflate blocks that end on a byte boundary
+/**
+	The data is compressed with fixed Huffman codes and a greedy match
+	finder that quickly picks up the long runs in flat images, falling
+	back to stored blocks if that doesn't make it smaller.  The blocks
+	end with a sync flush so chunks compressed on their own can be
+	joined, or with an empty final block if bLast is set.
+
+	pOut needs room for n + 5 * ( n / 65535 + 1 ) + 16 bytes.
+	Returns the compressed size.
+*/
+static int ezd_png_deflate( unsigned char *pOut, const unsigned char *pIn, int n, int *pHash, int bLast )
+{
+	int i = 0, k, d, len, max, cand;
+	unsigned int h, c;
+	SBitOut o;
 
-				mx += xl;
-				if ( x1 != x2 && mx > yl )
-					x1 += xd, mx -= yl;
+	o.pOut = pOut, o.uBits = 0, o.nBits = 0;
+	EZD_MEMSET( (char*)pHash, 0, (int)sizeof( int ) << EZD_PNG_HASH_BITS );
 
-				my += yl;
-				if ( y1 != y2 && my > xl )
-					y1 += yd, my -= xl;
+	// Fixed Huffman block
+	ezd_put_bits( &o, 2, 3 );
+	while ( i < n && o.pOut - pOut < n )
+	{
+		len = 0;
+		if ( i + 4 <= n )
+		{
+			// Positions are stored plus one so zero is empty
+			h = ( EZD_PNG_GET32( &pIn[ i ] ) * 2654435761u ) >> ( 32 - EZD_PNG_HASH_BITS );
+			cand = pHash[ h ] - 1, pHash[ h ] = i + 1;
+
+			if ( 0 <= cand && 32768 >= i - cand && EZD_PNG_GET32( &pIn[ cand ] ) == EZD_PNG_GET32( &pIn[ i ] ) )
+			{	max = ( 258 < n - i ) ? 258 : n - i;
+				for ( len = 4; len < max && pIn[ cand + len ] == pIn[ i + len ]; len++ )
+					;
+			} // end if
+		} // end if
 
-			} // end while
+		if ( !len )
+		{	c = g_ezd_png.uLit[ pIn[ i++ ] ];
+			EZD_PUT_CODE( &o, c );
+			continue;
+		} // end if
 
-		} break;
+		c = g_ezd_png.uLen[ len - 3 ];
+		EZD_PUT_CODE( &o, c );
 
-		case 32 :
-		{
-			// Color values
-			int mx = 0, my = 0;
+		d = i - cand;
+		k = ( 256 >= d ) ? g_ezd_png.uDist[ 0 ][ d - 1 ] : g_ezd_png.uDist[ 1 ][ ( d - 1 ) >> 7 ];
+		ezd_put_bits( &o, ezd_reverse_bits( k, 5 ), 5 );
+		ezd_put_bits( &o, d - ezd_dist_base[ k ], ezd_dist_extra[ k ] );
 
-			// Draw the line
-			while ( !done )
-			{
-				if ( x1 == x2 && y1 == y2 )
-					done = 1;
+		i += len;
 
-				// Plot pixel
-				if ( 0 <= x1 && x1 < w && 0 <= y1 && y1 < h )
-					*(unsigned int*)&p->pImage[ y1 * sw + x1 * pw ] = x_col;
+	} // end while
 
-				mx += xl;
-				if ( x1 != x2 && mx > yl )
-					x1 += xd, mx -= yl;
+	// End of block, unless it's no smaller than the data
+	if ( i >= n && o.pOut - pOut < n )
+		ezd_put_bits( &o, 0, 7 );
 
-				my += yl;
-				if ( y1 != y2 && my > xl )
-					y1 += yd, my -= xl;
+	// Store it instead
+	else
+	{	o.pOut = pOut, o.uBits = 0, o.nBits = 0;
+		for ( i = 0; i < n; i += k )
+		{	k = ( 65535 < n - i ) ? 65535 : n - i;
+			*o.pOut++ = 0;
+			*o.pOut++ = (unsigned char)k, *o.pOut++ = (unsigned char)( k >> 8 );
+			*o.pOut++ = (unsigned char)~k, *o.pOut++ = (unsigned char)( ~k >> 8 );
+			EZD_MEMCPY( (char*)o.pOut, (const char*)&pIn[ i ], k );
+			o.pOut += k;
+		} // end for
+	} // end else
 
-			} // end while
+	// Empty final block
+	if ( bLast )
+		ezd_put_bits( &o, 3, 3 ), ezd_put_bits( &o, 0, 7 );
 
-		} break;
+	// Sync flush, an empty stored block
+	else
+		ezd_put_bits( &o, 0, 3 );
 
-		default :
-			return 0;
+	if ( o.nBits )
+		ezd_put_bits( &o, 0, 8 - o.nBits );
 
-	} // end switch
+	if ( !bLast )
+		*o.pOut++ = 0, *o.pOut++ = 0, *o.pOut++ = 0xff, *o.pOut++ = 0xff;
 
-	return 1;
+	return (int)( o.pOut - pOut );
 }
 
-int ezd_rect( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+/// Paeth predictor
+static int ezd_paeth( int a, int b, int c )
 {
-	// Draw rectangle
-	return 		ezd_line( x_hDib, x1, y1, x2, y1, x_col )
-		   && 	ezd_line( x_hDib, x2, y1, x2, y2, x_col )
-		   &&	ezd_line( x_hDib, x2, y2, x1, y2, x_col )
-		   &&	ezd_line( x_hDib, x1, y2, x1, y1, x_col );
+	int pa = EZD_ABS( b - c ), pb = EZD_ABS( a - c ), pc = EZD_ABS( a + b - 2 * c );
+	return ( pa <= pb && pa <= pc ) ? a : ( pb <= pc ) ? b : c;
 }
 
-#define EZD_PI		( (double)3.141592654 )
-#define EZD_PI2		( EZD_PI * (double)2 )
-#define EZD_PI4		( EZD_PI * (double)4 )
+/// Adds the size of each filter's difference for one byte
+#define EZD_PNG_SUMS( s, x, a, b, c ) \
+	( s[ 0 ] += EZD_ABS( (signed char)(x) ), \
+	  s[ 1 ] += EZD_ABS( (signed char)( (x) - (a) ) ), \
+	  s[ 2 ] += EZD_ABS( (signed char)( (x) - (b) ) ), \
+	  s[ 3 ] += EZD_ABS( (signed char)( (x) - ( ( (a) + (b) ) >> 1 ) ) ), \
+	  s[ 4 ] += EZD_ABS( (signed char)( (x) - ezd_paeth( a, b, c ) ) ) )
 
-int ezd_arc( HEZDIMAGE x_hDib, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col )
-{
-#if defined( EZD_NO_MATH )
-	return 0;
-#else
-	double arc;
-	int i, w, h, sw, pw, px, py;
-	int res = (int)( (double)x_rad * EZD_PI4 ), resdraw;
-	unsigned char *pImg;
-	SImageData *p = (SImageData*)x_hDib;
+#if defined( EZD_SSE2 )
 
-	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
-		 || ( !p->pImage && !p->pfSetPixel ) )
-		return _ERR( 0, "Invalid parameters" );
+/// Paeth predictor for 16 bytes
+static __m128i ezd_paeth_sse2( __m128i a, __m128i b, __m128i c )
+{
+	int i;
+	__m128i z = _mm_setzero_si128(), r[ 2 ], a16, b16, c16, pa, pb, pc, na, nb;
+
+	// Two halves as 16 bit
+	for ( i = 0; i < 2; i++ )
+	{	a16 = i ? _mm_unpackhi_epi8( a, z ) : _mm_unpacklo_epi8( a, z );
+		b16 = i ? _mm_unpackhi_epi8( b, z ) : _mm_unpacklo_epi8( b, z );
+		c16 = i ? _mm_unpackhi_epi8( c, z ) : _mm_unpacklo_epi8( c, z );
+
+		pa = _mm_sub_epi16( b16, c16 ), pa = _mm_max_epi16( pa, _mm_sub_epi16( z, pa ) );
+		pb = _mm_sub_epi16( a16, c16 ), pb = _mm_max_epi16( pb, _mm_sub_epi16( z, pb ) );
+		pc = _mm_sub_epi16( _mm_add_epi16( a16, b16 ), _mm_add_epi16( c16, c16 ) );
+		pc = _mm_max_epi16( pc, _mm_sub_epi16( z, pc ) );
+
+		// a if it's closest, then b, then c
+		na = _mm_or_si128( _mm_cmpgt_epi16( pa, pb ), _mm_cmpgt_epi16( pa, pc ) );
+		nb = _mm_cmpgt_epi16( pb, pc );
+		r[ i ] = _mm_or_si128( _mm_and_si128( nb, c16 ), _mm_andnot_si128( nb, b16 ) );
+		r[ i ] = _mm_or_si128( _mm_and_si128( na, r[ i ] ), _mm_andnot_si128( na, a16 ) );
+	} // end for
 
-	// Dont' draw null arc
-	if ( x_dStart == x_dEnd )
-		return 1;
+	return _mm_packus_epi16( r[ 0 ], r[ 1 ] );
+}
 
-	// Ensure correct order
-	else if ( x_dStart > x_dEnd )
-	{	double t = x_dStart;
-		x_dStart = x_dEnd;
-		x_dEnd = t;
-	} // end if
+/// Sum of the differences in 16 bytes as signed values
+static __m128i ezd_png_sad_sse2( __m128i x, __m128i p )
+{
+	__m128i d = _mm_sub_epi8( x, p );
+	return _mm_sad_epu8( _mm_min_epu8( d, _mm_sub_epi8( _mm_setzero_si128(), d ) ), _mm_setzero_si128() );
+}
 
-	// Get arc size
-	arc = x_dEnd - x_dStart;
+/// Adds up the filter differences from byte i to near the end of the row, returns where it stopped
+static int ezd_png_sums_sse2( unsigned int *sum, const unsigned char *pCur, const unsigned char *pPrev, int i, int n, int bpp )
+{
+	int f;
+	unsigned long long s64[ 2 ];
+	__m128i s[ 5 ], x, a, b, c, avg;
+
+	for ( f = 0; f < 5; f++ )
+		s[ f ] = _mm_setzero_si128();
+
+	for ( ; i + 16 <= n; i += 16 )
+	{	x = _mm_loadu_si128( (const __m128i*)&pCur[ i ] );
+		a = _mm_loadu_si128( (const __m128i*)&pCur[ i - bpp ] );
+		b = _mm_loadu_si128( (const __m128i*)&pPrev[ i ] );
+		c = _mm_loadu_si128( (const __m128i*)&pPrev[ i - bpp ] );
+
+		// The average rounds down
+		avg = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), _mm_set1_epi8( 1 ) ) );
+
+		s[ 0 ] = _mm_add_epi64( s[ 0 ], ezd_png_sad_sse2( x, _mm_setzero_si128() ) );
+		s[ 1 ] = _mm_add_epi64( s[ 1 ], ezd_png_sad_sse2( x, a ) );
+		s[ 2 ] = _mm_add_epi64( s[ 2 ], ezd_png_sad_sse2( x, b ) );
+		s[ 3 ] = _mm_add_epi64( s[ 3 ], ezd_png_sad_sse2( x, avg ) );
+		s[ 4 ] = _mm_add_epi64( s[ 4 ], ezd_png_sad_sse2( x, ezd_paeth_sse2( a, b, c ) ) );
+	} // end for
 
-	// How many points to draw
-	resdraw = ( EZD_PI2 <= arc ) ? res : (int)( arc * (double)res / EZD_PI2 );
+	for ( f = 0; f < 5; f++ )
+	{	_mm_storeu_si128( (__m128i*)s64, s[ f ] );
+		sum[ f ] += (unsigned int)( s64[ 0 ] + s64[ 1 ] );
+	} // end for
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
+	return i;
+}
 
-	// Ensure pixel is within the image
-	if ( 0 > x || x >= w || 0 > y || y >= h )
-	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, w, h );
-		return 0;
-	} // en dif
+#endif
 
-	// Check for user callback function
-	if ( p->pfSetPixel )
-	{
-		// Draw the circle
-		for ( i = 0; i < resdraw; i++ )
-		{
-			// Offset for this pixel
-			px = x + (int)( (double)x_rad * cos( x_dStart + (double)i * EZD_PI2 / (double)res ) );
-			py = y + (int)( (double)x_rad * sin( x_dStart + (double)i * EZD_PI2 / (double)res ) );
+/// Filters a row into pDst, after the filter type
+/**
+	Picks the filter with the smallest sum of differences, which
+	is usually the one that compresses best.  bpp is bytes per pixel,
+	zero for palette images, which are never filtered.
+*/
+static void ezd_png_filter( unsigned char *pDst, const unsigned char *pCur, const unsigned char *pPrev, int n, int bpp )
+{
+	int i, f, best = 0;
+	unsigned int sum[ 5 ] = { 0, 0, 0, 0, 0 };
+
+	// A row the same as the one above is all zeros with Up
+	if ( bpp && !EZD_MEMCMP( pCur, pPrev, n ) )
+		best = 2;
+
+	else if ( bpp )
+	{	for ( i = 0; i < bpp && i < n; i++ )
+			EZD_PNG_SUMS( sum, pCur[ i ], 0, pPrev[ i ], 0 );
+#if defined( EZD_SSE2 )
+		i = ezd_png_sums_sse2( sum, pCur, pPrev, i, n, bpp );
+#endif
+		for ( ; i < n; i++ )
+			EZD_PNG_SUMS( sum, pCur[ i ], pCur[ i - bpp ], pPrev[ i ], pPrev[ i - bpp ] );
 
-			// Plot pixel
-			if ( 0 <= px && px < w && 0 <= py && py < h )
-				if ( !p->pfSetPixel( p->pSetPixelUser, px, py, x_col, 0 ) )
-					return 0;
+		for ( f = 1; f < 5; f++ )
+			if ( sum[ f ] < sum[ best ] )
+				best = f;
+	} // end else if
 
-		} // end while
+	*pDst++ = (unsigned char)best;
+	switch ( best )
+	{
+		case 0 :
+			EZD_MEMCPY( (char*)pDst, (const char*)pCur, n );
+			break;
 
-		return 1;
+		case 1 :
+			EZD_MEMCPY( (char*)pDst, (const char*)pCur, bpp );
+			for ( i = bpp; i < n; i++ )
+				pDst[ i ] = (unsigned char)( pCur[ i ] - pCur[ i - bpp ] );
+			break;
 
-	} // end if
+		case 2 :
+			for ( i = 0; i < n; i++ )
+				pDst[ i ] = (unsigned char)( pCur[ i ] - pPrev[ i ] );
+			break;
 
-	// Pixel and scan width
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 4 );
+		case 3 :
+			for ( i = 0; i < bpp; i++ )
+				pDst[ i ] = (unsigned char)( pCur[ i ] - ( pPrev[ i ] >> 1 ) );
+			for ( ; i < n; i++ )
+				pDst[ i ] = (unsigned char)( pCur[ i ] - ( ( pCur[ i - bpp ] + pPrev[ i ] ) >> 1 ) );
+			break;
 
-	switch( p->bih.biBitCount )
-	{
-		case 1:
-		{
-			int c = EZD_COMPARE_THRESHOLD( x_col, p->colThreshold );
-			static unsigned char xm[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+		default :
+			for ( i = 0; i < bpp; i++ )
+				pDst[ i ] = (unsigned char)( pCur[ i ] - pPrev[ i ] );
+#if defined( EZD_SSE2 )
+			for ( ; i + 16 <= n; i += 16 )
+				_mm_storeu_si128( (__m128i*)&pDst[ i ],
+								  _mm_sub_epi8( _mm_loadu_si128( (const __m128i*)&pCur[ i ] ),
+												ezd_paeth_sse2( _mm_loadu_si128( (const __m128i*)&pCur[ i - bpp ] ),
+																_mm_loadu_si128( (const __m128i*)&pPrev[ i ] ),
+																_mm_loadu_si128( (const __m128i*)&pPrev[ i - bpp ] ) ) ) );
+#endif
+			for ( ; i < n; i++ )
+				pDst[ i ] = (unsigned char)( pCur[ i ] - ezd_paeth( pCur[ i - bpp ], pPrev[ i ], pPrev[ i - bpp ] ) );
+			break;
 
-			// Draw the circle
-			for ( i = 0; i < resdraw; i++ )
-			{
-				// Offset for this pixel
-				px = x + (int)( (double)x_rad * cos( x_dStart + (double)i * EZD_PI2 / (double)res ) );
-				py = y + (int)( (double)x_rad * sin( x_dStart + (double)i * EZD_PI2 / (double)res ) );
+	} // end switch
+}
 
-				// Plot pixel
-				if ( 0 <= px && px < w && 0 <= py && py < h )
-				{
-					if ( c )
-						p->pImage[ py * sw + ( px >> 3 ) ] |= xm[ px & 7 ];
-					else
-						p->pImage[ py * sw + ( px >> 3 ) ] &= ~xm[ px & 7 ];
+/// Compressed chunk of rows
+typedef struct _SPngChunk
+{
+	/// Compressed data, after two bytes left for the zlib header
+	unsigned char		*pOut;
+	int					nOut;
 
-				} // end if
+	/// Adler-32 and size of the filtered rows
+	unsigned int		uAdler;
+	int					nIn;
 
-			} // end while
+} SPngChunk;
 
-		} break;
+/// Work shared by the threads compressing a png
+typedef struct _SPngJob
+{
+	/// Image being saved
+	SImageData			*p;
 
-		case 24 :
-		{
-			// Color values
-			unsigned char r = x_col & 0xff;
-			unsigned char g = ( x_col >> 8 ) & 0xff;
-			unsigned char b = ( x_col >> 16 ) & 0xff;
-			for ( i = 0; i < resdraw; i++ )
-			{
-				// Offset for this pixel
-				px = x + (int)( (double)x_rad * cos( x_dStart + (double)i * EZD_PI2 / (double)res ) );
-				py = y + (int)( (double)x_rad * sin( x_dStart + (double)i * EZD_PI2 / (double)res ) );
-
-				// If it falls on the image
-				if ( 0 <= px && px < w && 0 <= py && py < h )
-				{	pImg = &p->pImage[ py * sw + px * pw ];
-					pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
-				} // end if
+	/// Bytes per row and per pixel, zero for palette images
+	int					nRaw;
+	int					nPix;
 
-			} // end for
+	/// Rows per chunk and number of chunks
+	int					nRows;
+	int					nChunks;
 
-		} break;
+	/// Chunks being compressed, the next one is guarded by lock
+	int					nFirst;
+	int					nNext;
+	int					nEnd;
 
-		case 32 :
-			for ( i = 0; i < resdraw; i++ )
-			{
-				// Offset for this pixel
-				px = x + (int)( (double)x_rad * sin( (double)i * EZD_PI2 / (double)res ) );
-				py = y + (int)( (double)x_rad * cos( (double)i * EZD_PI2 / (double)res ) );
+	/// Working memory for each chunk and its size
+	unsigned char		*pMem;
+	int					nMem;
 
-				// If it falls on the image
-				if ( 0 <= px && px < w && 0 <= py && py < h )
-					*(unsigned int*)&p->pImage[ py * sw + px * pw ] = x_col;
+	/// Results
+	SPngChunk			ch[ EZD_MAX_THREADS ];
 
-			} // end for
+	/// Guards nNext
+	t_ezd_mutex			lock;
 
-			break;
+} SPngJob;
 
-		default :
-			return 0;
+/// Reads a row top down in png byte order
+static void ezd_png_row( SPngJob *j, int y, unsigned char *pDst )
+{
+	int x, a, c;
+	const unsigned char *s;
+	SImageData *p = j->p;
+
+	// Callback images are read back like ezd_save_stream()
+	if ( !p->pImage )
+	{	for ( x = 0; x < p->nWidth; x++, pDst += 3 )
+		{	c = p->pfSetPixel( p->pSetPixelUser, x, y, 0xffffff, -1 );
+			pDst[ 0 ] = ( c >> 16 ) & 0xff, pDst[ 1 ] = ( c >> 8 ) & 0xff, pDst[ 2 ] = c & 0xff;
+		} // end for
+		return;
+	} // end if
 
-	} // end switch
+	// Positive heights are bottom up
+	s = EZD_ROW( p, ( 0 < p->bih.biHeight ) ? p->nHeight - 1 - y : y );
 
-	return 1;
-#endif
-}
+	if ( !j->nPix )
+		EZD_MEMCPY( (char*)pDst, (const char*)s, j->nRaw );
 
+	else if ( 16 == p->bih.biBitCount )
+		for ( x = 0; x < p->nWidth; x++, pDst += 3 )
+		{	c = ezd_px_color( p, ezd_get_v( p, s, x ) );
+			pDst[ 0 ] = ( c >> 16 ) & 0xff, pDst[ 1 ] = ( c >> 8 ) & 0xff, pDst[ 2 ] = c & 0xff;
+		} // end for
 
-int ezd_circle( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col )
-{
-	return ezd_arc( x_hDib, x, y, x_rad, 0, EZD_PI2, x_col );
+	else if ( 3 == j->nPix )
+		for ( x = 0; x < p->nWidth; x++, s += p->nPixel, pDst += 3 )
+			pDst[ 0 ] = s[ 2 ], pDst[ 1 ] = s[ 1 ], pDst[ 2 ] = s[ 0 ];
+
+	else if ( EZD_ALPHA_PREMULTIPLIED != p->nAlpha )
+		for ( x = 0; x < p->nWidth; x++, s += 4, pDst += 4 )
+			pDst[ 0 ] = s[ 2 ], pDst[ 1 ] = s[ 1 ], pDst[ 2 ] = s[ 0 ], pDst[ 3 ] = s[ 3 ];
+
+	// Png alpha isn't premultiplied
+	else
+		for ( x = 0; x < p->nWidth; x++, s += 4, pDst += 4 )
+		{	a = s[ 3 ];
+			for ( c = 0; c < 3; c++ )
+				pDst[ c ] = !a ? 0 : ( s[ 2 - c ] >= a ) ? 255 : (unsigned char)( ( s[ 2 - c ] * 255 + a / 2 ) / a );
+			pDst[ 3 ] = (unsigned char)a;
+		} // end for
 }
 
-int ezd_fill_rect( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col )
+/// Filters and compresses chunks until there are none left
+static void ezd_png_worker( void *pJob )
 {
-	int w, h, x, y, sw, pw, fw, fh;
-	unsigned char *pStart, *pPos;
-	SImageData *p = (SImageData*)x_hDib;
+	int c, y, end, n;
+	int *pHash;
+	unsigned char *pIn, *pPrev, *pCur, *t;
+	SPngChunk *ch;
+	SPngJob *j = (SPngJob*)pJob;
 
-	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize
-		 || ( !p->pImage && !p->pfSetPixel ) )
-		return _ERR( 0, "Invalid parameters" );
+	for ( ; ; )
+	{
+		// Take the next chunk
+		EZD_LOCK( &j->lock );
+		c = ( j->nNext < j->nEnd ) ? j->nNext++ : j->nEnd;
+		EZD_UNLOCK( &j->lock );
+
+		if ( c >= j->nEnd )
+			return;
+
+		// Working memory
+		pHash = (int*)&j->pMem[ ( c - j->nFirst ) * j->nMem ];
+		pIn = (unsigned char*)&pHash[ 1 << EZD_PNG_HASH_BITS ];
+		pPrev = &pIn[ j->nRows * ( j->nRaw + 1 ) ];
+		pCur = &pPrev[ j->nRaw ];
+
+		ch = &j->ch[ c - j->nFirst ];
+		ch->pOut = &pCur[ j->nRaw ];
+
+		// Rows are filtered against the row above, even in another chunk
+		y = c * j->nRows;
+		end = ( j->p->nHeight - y < j->nRows ) ? j->p->nHeight : y + j->nRows;
+		if ( y )
+			ezd_png_row( j, y - 1, pPrev );
+		else
+			EZD_MEMSET( (char*)pPrev, 0, j->nRaw );
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
+		for ( n = 0; y < end; y++, n += j->nRaw + 1 )
+		{	ezd_png_row( j, y, pCur );
+			ezd_png_filter( &pIn[ n ], pCur, pPrev, j->nRaw, j->nPix );
+			t = pPrev, pPrev = pCur, pCur = t;
+		} // end for
 
-	// Swap coords if needed
-	if ( x1 > x2 ) { int t = x1; x1 = x2; x2 = t; }
-	if ( y1 > y2 ) { int t = y1; y1 = y2; y2 = t; }
+		ch->nIn = n;
+		ch->uAdler = ezd_adler32( 1, pIn, n );
+		ch->nOut = ezd_png_deflate( &ch->pOut[ 2 ], pIn, n, pHash, c == j->nChunks - 1 );
 
-	// Clip
-	if ( 0 > x1 ) x1 = 0; else if ( x1 >= w ) x1 = w - 1;
-	if ( 0 > y1 ) y1 = 0; else if ( y1 >= h ) y1 = h - 1;
-	if ( 0 > x2 ) x2 = 0; else if ( x2 >= w ) x2 = w - 1;
-	if ( 0 > y2 ) y2 = 0; else if ( y2 >= h ) y2 = h - 1;
+	} // end for
+}
 
-	// Fill width and height
-	fw = x2 - x1;
-	fh = y2 - y1;
+/// Writes a png chunk
+static int ezd_png_chunk( t_ezd_write pfWrite, void *pUser, const char *pType, const unsigned char *pData, int nData )
+{
+	unsigned char buf[ 8 ];
 
-	// Are we left with a valid region
-	if ( 0 > fw || 0 > fh )
-	{	_SHOW( "Invalid fill rect : %d,%d -> %d,%d : %dx%d ",
-			   x1, y1, x2, y2, w, h );
+	ezd_put_be32( buf, nData );
+	EZD_MEMCPY( (char*)&buf[ 4 ], pType, 4 );
+	if ( !pfWrite( pUser, buf, 8 ) || ( nData && !pfWrite( pUser, pData, nData ) ) )
 		return 0;
-	} // en dif
 
-	// Check for user callback function
-	if ( p->pfSetPixel )
-	{
-		// Fill each pixel
-		for ( y = y1; y < y2; y++ )
-			for( x = x1; x < x2; x++ )
-				if ( 0 <= x && x < w && 0 <= y && y < h )
-					if ( !p->pfSetPixel( p->pSetPixelUser, x, y, x_col, 0 ) )
-						return 0;
+	ezd_put_be32( buf, ezd_crc32( ezd_crc32( 0, &buf[ 4 ], 4 ), pData, nData ) );
+	return pfWrite( pUser, buf, 4 );
+}
 
-		return 1;
+#endif
 
-	} // end if
+int ezd_save_png_stream( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	int i, n, ok, nThreads;
+	unsigned int adler = 1;
+	unsigned char hdr[ 13 ], pal[ 256 * 3 ], *pData;
+	static const unsigned char sig[ 8 ] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+	SPngJob j;
+	SImageData *p = (SImageData*)x_hDib;
 
-	// Pixel and scan width
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 1 );
+	// Sanity checks
+	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !x_pfWrite )
+		return _ERR( 0, "Invalid parameters" );
 
-	// Set the first line
-	switch( p->bih.biBitCount )
-	{
-		case 1 :
-		{
-			int c = EZD_COMPARE_THRESHOLD( x_col, p->colThreshold );
-			static unsigned char xm[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	// Only one band is in memory while rendering bands
+	if ( p->nBandRows )
+		return _ERR( 0, "Can't save while rendering bands" );
+
+	if ( !p->pImage && !p->pfSetPixel )
+		return _ERR( 0, "No image data or set pixel callback" );
+
+	// Bit depth and color type, 32 bit images only keep alpha in the alpha modes
+	j.p = p;
+	ezd_put_be32( hdr, p->nWidth );
+	ezd_put_be32( &hdr[ 4 ], p->nHeight );
+	hdr[ 8 ] = 8, hdr[ 9 ] = 2, hdr[ 10 ] = hdr[ 11 ] = hdr[ 12 ] = 0;
+	j.nPix = 3;
+	if ( p->pImage && ezd_palette_size( p ) )
+		hdr[ 8 ] = (unsigned char)p->bih.biBitCount, hdr[ 9 ] = 3, j.nPix = 0;
+	else if ( p->pImage && 32 == p->bih.biBitCount && p->nAlpha )
+		hdr[ 9 ] = 6, j.nPix = 4;
+
+	j.nRaw = j.nPix ? p->nWidth * j.nPix : ( p->nWidth * p->bih.biBitCount + 7 ) / 8;
+	j.nRows = ( EZD_PNG_CHUNK > j.nRaw + 1 ) ? EZD_PNG_CHUNK / ( j.nRaw + 1 ) : 1;
+	j.nChunks = ( p->nHeight + j.nRows - 1 ) / j.nRows;
+
+	// Callbacks are not thread safe
+	nThreads = EZD_PNG_THREADS ? EZD_PNG_THREADS : ezd_cpu_count();
+	if ( nThreads > EZD_MAX_THREADS )
+		nThreads = EZD_MAX_THREADS;
+	if ( nThreads > j.nChunks )
+		nThreads = j.nChunks;
+	if ( 1 > nThreads || !p->pImage )
+		nThreads = 1;
+
+	// Hash table, filtered rows, two raw rows, and the output with room for the zlib header and Adler-32
+	n = j.nRows * ( j.nRaw + 1 );
+	j.nMem = (int)EZD_ALIGN( ( (int)sizeof( int ) << EZD_PNG_HASH_BITS ) + n + 2 * j.nRaw
+							 + 2 + n + 5 * ( n / 65535 + 1 ) + 16 + 4, sizeof( int ) );
+	j.pMem = (unsigned char*)EZD_malloc( (size_t)j.nMem * nThreads );
+	if ( !j.pMem )
+		return _ERR( 0, "Out of memory" );
+
+	ezd_png_init();
+
+	ok = x_pfWrite( x_pUser, sig, sizeof( sig ) ) && ezd_png_chunk( x_pfWrite, x_pUser, "IHDR", hdr, 13 );
+
+	// Palette
+	if ( ok && !j.nPix )
+	{	n = ezd_palette_size( p ) * 3;
+		for ( i = 0; i < n; i++ )
+			pal[ i ] = (unsigned char)( p->pPalette[ i / 3 ] >> ( 16 - ( i % 3 ) * 8 ) );
+		ok = ezd_png_chunk( x_pfWrite, x_pUser, "PLTE", pal, n );
+	} // end if
 
-			// Just fill it in pixel by pixel for 1 bit images
-			for ( y = y1; y < y2; y++ )
-				for( x = x1; x < x2; x++ )
-					if ( 0 <= x && x < w && 0 <= y && y < h )
-					{
-						if ( c )
-							p->pImage[ y * sw + ( x >> 3 ) ] |= xm[ x & 7 ];
-						else
-							p->pImage[ y * sw + ( x >> 3 ) ] &= ~xm[ x & 7 ];
+	// Compress a chunk per thread at a time and write them in order, one IDAT each
+	EZD_LOCK_INIT( &j.lock );
+	for ( j.nFirst = 0; ok && j.nFirst < j.nChunks; j.nFirst = j.nEnd )
+	{
+		j.nNext = j.nFirst;
+		j.nEnd = ( j.nChunks - j.nFirst < nThreads ) ? j.nChunks : j.nFirst + nThreads;
+		ezd_run_threads( ezd_png_worker, &j, j.nEnd - j.nFirst );
 
-					} // end if
+		for ( i = j.nFirst; ok && i < j.nEnd; i++ )
+		{
+			SPngChunk *ch = &j.ch[ i - j.nFirst ];
 
-			return 1;
+			pData = &ch->pOut[ 2 ], n = ch->nOut;
+			if ( !i )
+				pData = ch->pOut, pData[ 0 ] = 0x78, pData[ 1 ] = 0x01, n += 2;
 
-		} break;
+			adler = i ? ezd_adler32_combine( adler, ch->uAdler, ch->nIn ) : ch->uAdler;
+			if ( i == j.nChunks - 1 )
+				ezd_put_be32( &pData[ n ], adler ), n += 4;
 
-		case 24 :
-		{
-			// Color values
-			unsigned char r = x_col & 0xff;
-			unsigned char g = ( x_col >> 8 ) & 0xff;
-			unsigned char b = ( x_col >> 16 ) & 0xff;
-			pStart = pPos = &p->pImage[ y1 * sw + x1 * pw ];
+			ok = ezd_png_chunk( x_pfWrite, x_pUser, "IDAT", pData, n );
 
-			// Set the first line
-			for( x = 0; x < fw; x++, pPos += pw )
-				pPos[ 0 ] = r, pPos[ 1 ] = g, pPos[ 2 ] = b;
+		} // end for
 
-		} break;
+	} // end for
+	EZD_LOCK_FREE( &j.lock );
 
-		case 32 :
-		{
-			// Set the first line
-			pStart = pPos = &p->pImage[ y1 * sw + x1 * pw ];
-			for( x = 0; x < fw; x++, pPos += pw )
-				*(unsigned int*)pPos = x_col;
+	EZD_free( j.pMem );
 
-		} break;
+	if ( !ok || !ezd_png_chunk( x_pfWrite, x_pUser, "IEND", 0, 0 ) )
+		return _ERR( 0, "Error writing png" );
 
-		default :
-			return 0;
+	return 1;
+#endif
+}
 
-	} // end switch
+int ezd_save_png_mem( HEZDIMAGE x_hDib, void *x_pBuf, int x_nBuf )
+{
+	int n = 0;
+	SMemWriter m;
 
-	// Copy remaining lines
-	pPos = pStart;
-	for( y = 1; y < fh; y++ )
-	{
-		// Skip to next line
-		pPos += sw;
-		EZD_MEMCPY( pPos, pStart, fw * pw );
+	// Without a buffer, just return the size
+	if ( !x_pBuf )
+		return ezd_save_png_stream( x_hDib, ezd_write_count, &n ) ? n : 0;
 
-	} // end for
+	m.pPos = (unsigned char*)x_pBuf, m.nLeft = x_nBuf;
+	if ( !ezd_save_png_stream( x_hDib, ezd_write_mem, &m ) )
+		return 0;
 
-	return 1;
+	return x_nBuf - m.nLeft;
 }
 
-int ezd_flood_fill( HEZDIMAGE x_hDib, int x, int y, int x_bcol, int x_col )
+int ezd_save_png( HEZDIMAGE x_hDib, const char *x_pFile )
 {
-#if defined( EZD_NO_ALLOCATION )
-	return 0;
-#else
-	int ok, n, i, ii, w, h, sw, pw, bc;
-	unsigned char r, g, b, br, bg, bb;
-	unsigned char *pImg, *map;
-	SImageData *p = (SImageData*)x_hDib;
+	return ezd_save_file( x_hDib, x_pFile, ezd_save_png_stream );
+}
 
-	if ( !p || sizeof( SBitmapInfoHeader ) != p->bih.biSize || !p->pImage )
-		return _ERR( 0, "Invalid parameters" );
+//------------------------------------------------------------------
+// Display lists
+//------------------------------------------------------------------
+
+/// Display list commands
+enum
+{
+	EZD_CMD_FILL = 1,
+	EZD_CMD_SET_PIXEL,
+	EZD_CMD_LINE,
+	EZD_CMD_LINE_AA,
+	EZD_CMD_RECT,
+	EZD_CMD_FILL_RECT,
+	EZD_CMD_ARC,
+	EZD_CMD_CIRCLE_AA,
+	EZD_CMD_FILL_ELLIPSE,
+	EZD_CMD_FILL_PIE,
+	EZD_CMD_FILL_POLYGON,
+	EZD_CMD_TEXT
+};
+
+/// Display list command header, followed by the command's data
+typedef struct _SListCmd
+{
+	/// Command type, EZD_CMD_*
+	int					nType;
 
-	// +++ Fix ezd_flood_fill() for 1 bpp
-	if ( 1 == p->bih.biBitCount )
-		return 0; // _ERR( 0, "Invalid pixel depth" );
+	/// Size of the command and its data in bytes, a multiple of 8
+	int					nSize;
 
-	// Calculate image metrics
-	w = EZD_ABS( p->bih.biWidth );
-	h = EZD_ABS( p->bih.biHeight );
+	/// Box the command can draw in, right and bottom are exclusive
+	int					l, t, r, b;
 
-	// Ensure pixel is within the image
-	if ( 0 > x || x >= w || 0 > y || y >= h )
-	{	_SHOW( "Point out of range : %d,%d : %dx%d ", x, y, w, h );
-		return 0;
-	} // en dif
+	/// Color
+	int					col;
 
-	// Pixel and scan width
-	pw = EZD_FITTO( p->bih.biBitCount, 8 );
-	sw = EZD_SCANWIDTH( w, p->bih.biBitCount, 4 );
+	/// Number of polygon points or text characters
+	int					n;
 
-	// Set the image pointer
-	pImg = p->pImage;
+} SListCmd;
 
-	// Allocate space for fill map
-	map = (unsigned char*)EZD_calloc( w * h, 1 );
-	if ( !map )
-		return 0;
+/// Display list
+typedef struct _SDrawList
+{
+	/// Command buffer
+	unsigned char		*pBuf;
 
-	// Prepare 24 bit color components
-	r = x_col & 0xff; g = ( x_col >> 8 ) & 0xff; b = ( x_col >> 16 ) & 0xff;
-	br = x_bcol & 0xff; bg = ( x_bcol >> 8 ) & 0xff; bb = ( x_bcol >> 16 ) & 0xff;
+	/// Bytes used and allocated in pBuf
+	int					nUsed;
+	int					nAlloc;
 
-	// Initialize indexes
-	i = y * w + x;
-	ii = y * sw + x * pw;
+	/// Number of commands
+	int					nCmds;
 
-	// Save away bit count
-	bc = p->bih.biBitCount;
+	/// Box around all commands
+	int					l, t, r, b;
 
-	// Crawl the map
-	while ( ( map[ i ] & 0x0f ) <= 3 )
-	{
+} SDrawList;
 
-		if ( ( map[ i ] & 0x0f ) == 0 )
-		{
-			// In the name of simplicity
-			switch( bc )
-			{
-				case 24 :
-					pImg[ ii ] = r;
-					pImg[ ii + 1 ] = g;
-					pImg[ ii + 2 ] = b;
-					break;
+/// Limits a coordinate to an int
+#define EZD_LIST_CLAMP( v ) (int)( ( -0x7fffffffLL > (v) ) ? -0x7fffffffLL : ( 0x7fffffffLL < (v) ) ? 0x7fffffffLL : (v) )
 
-				case 32 :
-					*(unsigned int*)&p->pImage[ ii ] = x_col;
-					break;
+#if !defined( EZD_NO_ALLOCATION )
 
-			} // end switch
+/// Appends a command with nData bytes of data, returns the data or zero
+static void* ezd_list_add( HEZDLIST x_hList, int type, long long l, long long t, long long r, long long b,
+						   int col, int n, int nData )
+{
+	SListCmd *c;
+	SDrawList *p = (SDrawList*)x_hList;
+	int nSize = EZD_ALIGN( (int)sizeof( SListCmd ) + nData, 8 );
 
-			// Point to next direction
-			map[ i ] &= 0xf0, map[ i ] |= 1;
+	if ( !p || 0 > nData )
+		return _ERR( (void*)0, "Invalid parameters" );
 
-			// Can we go up?
-			if ( y < ( h - 1 ) )
-			{
-				n = ( y + 1 ) * sw + x * pw;
-				switch( bc )
-				{	case 24 :
-						ok = pImg[ n ] != r || pImg[ n + 1 ] != g || pImg[ n + 2 ] != b;
-						if ( ok ) ok = pImg[ n ] != br || pImg[ n + 1 ] != bg || pImg[ n + 2 ] != bb;
-						break;
-					case 32 :
-						ok = *(unsigned int*)&pImg[ n ] != x_col;
-						if ( ok ) ok = *(unsigned int*)&pImg[ n ] != x_bcol;
-						break;
-				} // end switch
+	// Grow the buffer
+	if ( p->nUsed + nSize > p->nAlloc )
+	{
+		int nAlloc = p->nAlloc ? p->nAlloc * 2 : 1024;
+		unsigned char *pNew;
 
-				if ( ok )
-				{	y++;
-					i = y * w + x;
-					map[ i ] = 0x10;
-					ii = n;
-				} // end if
+		while ( nAlloc < p->nUsed + nSize )
+			nAlloc *= 2;
 
-			} // end if
+		pNew = (unsigned char*)EZD_malloc( nAlloc );
+		if ( !pNew )
+			return _ERR( (void*)0, "Out of memory" );
 
+		if ( p->pBuf )
+		{	EZD_MEMCPY( (char*)pNew, (const char*)p->pBuf, p->nUsed );
+			EZD_free( p->pBuf );
 		} // end if
 
-		if ( ( map[ i ] & 0x0f ) == 1 )
-		{
-			// Point to next direction
-			map[ i ] &= 0xf0, map[ i ] |= 2;
+		p->pBuf = pNew;
+		p->nAlloc = nAlloc;
 
-			// Can we go right?
-			if ( x < ( w - 1 ) )
-			{
-				n = y * sw + ( x + 1 ) * pw;
-				switch( bc )
-				{	case 24 :
-						ok = pImg[ n ] != r || pImg[ n + 1 ] != g || pImg[ n + 2 ] != b;
-						if ( ok ) ok = pImg[ n ] != br || pImg[ n + 1 ] != bg || pImg[ n + 2 ] != bb;
-						break;
-					case 32 :
-						ok = *(unsigned int*)&pImg[ n ] != x_col;
-						if ( ok ) ok = *(unsigned int*)&pImg[ n ] != x_bcol;
-						break;
-				} // end switch
+	} // end if
 
-				if ( ok )
-				{	x++;
-					i = y * w + x;
-					map[ i ] = 0x20;
-					ii = n;
-				} // end if
+	c = (SListCmd*)&p->pBuf[ p->nUsed ];
+	c->nType = type, c->nSize = nSize, c->col = col, c->n = n;
+	c->l = EZD_LIST_CLAMP( l ), c->t = EZD_LIST_CLAMP( t );
+	c->r = EZD_LIST_CLAMP( r ), c->b = EZD_LIST_CLAMP( b );
 
-			} // end if
+	// Grow the list box
+	if ( !p->nCmds || c->l < p->l ) p->l = c->l;
+	if ( !p->nCmds || c->t < p->t ) p->t = c->t;
+	if ( !p->nCmds || c->r > p->r ) p->r = c->r;
+	if ( !p->nCmds || c->b > p->b ) p->b = c->b;
 
-		} // end if
+	p->nUsed += nSize;
+	p->nCmds++;
 
-		if ( ( map[ i ] & 0x0f ) == 2 )
-		{
-			// Point to next direction
-			map[ i ] &= 0xf0, map[ i ] |= 3;
+	return c + 1;
+}
 
-			// Can we go down?
-			if ( y > 0 )
-			{
-				n = ( y - 1 ) * sw + x * pw;
-				switch( bc )
-				{	case 24 :
-						ok = pImg[ n ] != r || pImg[ n + 1 ] != g || pImg[ n + 2 ] != b;
-						if ( ok ) ok = pImg[ n ] != br || pImg[ n + 1 ] != bg || pImg[ n + 2 ] != bb;
-						break;
-					case 32 :
-						ok = *(unsigned int*)&pImg[ n ] != x_col;
-						if ( ok ) ok = *(unsigned int*)&pImg[ n ] != x_bcol;
-						break;
-				} // end switch
+/// Appends a command with up to four int parameters
+static int ezd_list_add_ints( HEZDLIST x_hList, int type, long long l, long long t, long long r, long long b,
+							  int col, int a0, int a1, int a2, int a3 )
+{
+	int *v = (int*)ezd_list_add( x_hList, type, l, t, r, b, col, 0, 4 * sizeof( int ) );
+	if ( !v )
+		return 0;
 
-				if ( ok )
-				{	y--;
-					i = y * w + x;
-					map[ i ] = 0x30;
-					ii = n;
-				} // end if
+	v[ 0 ] = a0, v[ 1 ] = a1, v[ 2 ] = a2, v[ 3 ] = a3;
 
-			} // end if
+	return 1;
+}
 
-		} // end if
+/// Appends an arc or pie command
+static int ezd_list_add_arc( HEZDLIST x_hList, int type, int x, int y, int rad, double s, double e, int col )
+{
+	double *a = (double*)ezd_list_add( x_hList, type, (long long)x - rad, (long long)y - rad,
+									   (long long)x + rad + 1, (long long)y + rad + 1,
+									   col, 0, 2 * sizeof( double ) + 3 * sizeof( int ) );
+	if ( !a )
+		return 0;
 
-		if ( ( map[ i ] & 0x0f ) == 3 )
-		{
-			// Point to next
-			map[ i ] &= 0xf0, map[ i ] |= 4;
+	a[ 0 ] = s, a[ 1 ] = e;
+	( (int*)( a + 2 ) )[ 0 ] = x, ( (int*)( a + 2 ) )[ 1 ] = y, ( (int*)( a + 2 ) )[ 2 ] = rad;
 
-			// Can we go left
-			if ( x > 0 )
-			{
-				n = y * sw + ( x - 1 ) * pw;
-				switch( bc )
-				{	case 24 :
-						ok = pImg[ n ] != r || pImg[ n + 1 ] != g || pImg[ n + 2 ] != b;
-						if ( ok ) ok = pImg[ n ] != br || pImg[ n + 1 ] != bg || pImg[ n + 2 ] != bb;
-						break;
-					case 32 :
-						ok = *(unsigned int*)&pImg[ n ] != x_col;
-						if ( ok ) ok = *(unsigned int*)&pImg[ n ] != x_bcol;
-						break;
-				} // end switch
+	return 1;
+}
 
-				if ( ok )
-				{	x--;
-					i = y * w + x;
-					map[ i ] = 0x40;
-					ii = n;
-				} // end if
+/// Grows a box to include the rows and columns ezd_text() draws a glyph in
+static void ezd_text_box( HEZDFONT x_hFont, const char *pText, int nLen, int x, int y, long long *pBox )
+{
+#if defined( EZD_STATIC_FONTS )
 
-			} // end if
+	// Static fonts have no font metrics, so the text is never culled
+	pBox[ 0 ] = pBox[ 1 ] = -0x7fffffffLL;
+	pBox[ 2 ] = pBox[ 3 ] = 0x7fffffffLL;
 
-		} // end if
+#else
+	int i, d, lx, ly, mh, ox, oy, gh;
+	const tGlyph *g;
+	SFontData *f = (SFontData*)x_hFont;
 
-		// Time to backup?
-		while ( ( map[ i ] & 0xf0 ) > 0 && ( map[ i ] & 0x0f ) > 3 )
+	// The font is drawn up or down depending on the image, so allow for both
+	for ( d = -1; d <= 1; d += 2 )
+		for ( i = 0, lx = x, ly = y, mh = 0; i < nLen; i++ )
 		{
-			// Go back
-			if ( ( map[ i ] & 0xf0 ) == 0x10 ) y--;
-			else if ( ( map[ i ] & 0xf0 ) == 0x20 ) x--;
-			else if ( ( map[ i ] & 0xf0 ) == 0x30 ) y++;
-			else if ( ( map[ i ] & 0xf0 ) == 0x40 ) x++;
+			if ( '\r' == pText[ i ] )
+				lx = x;
 
-			// Set indexes
-			i = y * w + x;
-			ii = y * sw + x * pw;
+			else if ( '\n' == pText[ i ] )
+				lx = x, ly += d * ( 1 + mh ), mh = 0;
 
-		} // end while
+			else if ( 0 != ( g = (const tGlyph*)ezd_find_glyph( x_hFont, pText[ i ] ) ) )
+			{
+				// Same placement as ezd_text()
+				gh = (int)g->bbox.height + (int)g->bbox.yoffset;
+				if ( (int)g->bbox.width + (int)g->bbox.xoffset && gh )
+				{	ox = lx + (int)g->bbox.xoffset;
+					oy = ly + (int)f->bbox.height + (int)f->bbox.yoffset - gh;
+					if ( ox < pBox[ 0 ] ) pBox[ 0 ] = ox;
+					if ( ox + g->bbox.width > pBox[ 2 ] ) pBox[ 2 ] = ox + g->bbox.width;
+					if ( oy - g->bbox.height + 1 < pBox[ 1 ] ) pBox[ 1 ] = oy - g->bbox.height + 1;
+					if ( oy + g->bbox.height > pBox[ 3 ] ) pBox[ 3 ] = oy + g->bbox.height;
+				} // end if
 
-	} // end if
+				lx += f->spacing + g->xoffsetnext;
+				mh = ( gh > mh ) ? gh : mh;
 
-	EZD_free( map );
+			} // end else if
 
-	return 1;
+		} // end for
 #endif
 }
 
-static void ezd_draw_bmp_cb( unsigned char *pImg, int x, int y, int sw, int pw, 
-							 int inv, int bw, int bh, const unsigned char *pBmp, 
-							 int col, int ch, t_ezd_set_pixel pf, void *pUser )
-{
-	int w, h, lx = x;
-	unsigned char m = 0x80;
-	//unsigned char r = col & 0xff;
-	//unsigned char g = ( col >> 8 ) & 0xff;
-	//unsigned char b = ( col >> 16 ) & 0xff;
-	//static unsigned char xm[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+#endif
 
-	// Draw the glyph
-	for( h = 0; h < bh; h++ )
-	{
-		// Draw horz line
-		for( w = 0; w < bw; w++ )
-		{
-			// Next glyph byte?
-			if ( !m )
-				m = 0x80, pBmp++;
+HEZDLIST ezd_list_create()
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	SDrawList *p = (SDrawList*)EZD_malloc( sizeof( SDrawList ) );
+	if ( !p )
+		return _ERR( (HEZDLIST)0, "Out of memory" );
 
-			// Is this pixel on?
-			if ( *pBmp & m )
-				if ( !pf( pUser, lx, y, col, ch ) )
-					return;
+	EZD_MEMSET( (char*)p, 0, sizeof( SDrawList ) );
 
-			// Next bmp bit
-			m >>= 1;
+	return (HEZDLIST)p;
+#endif
+}
 
-			// Next x pixel
-			lx++;
+void ezd_list_destroy( HEZDLIST x_hList )
+{
+#if !defined( EZD_NO_ALLOCATION )
+	SDrawList *p = (SDrawList*)x_hList;
+	if ( !p )
+		return;
 
-		} // end for
+	if ( p->pBuf )
+		EZD_free( p->pBuf );
 
-		// Reset x
-		lx = x;
+	EZD_free( p );
+#endif
+}
 
-		// Reset y
-		y++;
+int ezd_list_clear( HEZDLIST x_hList )
+{
+	SDrawList *p = (SDrawList*)x_hList;
+	if ( !p )
+		return _ERR( 0, "Invalid parameters" );
 
-	} // end for
+	p->nUsed = p->nCmds = 0;
+	p->l = p->t = p->r = p->b = 0;
 
+	return 1;
 }
 
-static void ezd_draw_bmp_1( unsigned char *pImg, int x, int y, int sw, int pw, 
-							int inv, int bw, int bh, const unsigned char *pBmp, int col )
+int ezd_list_get_count( HEZDLIST x_hList )
 {
-	int w, h, lx = x;
-	unsigned char m = 0x80;
-	//unsigned char r = col & 0xff;
-	//unsigned char g = ( col >> 8 ) & 0xff;
-	//unsigned char b = ( col >> 16 ) & 0xff;
-	static unsigned char xm[] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
+	SDrawList *p = (SDrawList*)x_hList;
+	if ( !p )
+		return _ERR( 0, "Invalid parameters" );
 
-	// Draw the glyph
-	for( h = 0; h < bh; h++ )
-	{
-		// Draw horz line
-		for( w = 0; w < bw; w++ )
-		{
-			// Next glyph byte?
-			if ( !m )
-				m = 0x80, pBmp++;
+	return p->nCmds;
+}
 
-			// Is this pixel on?
-			if ( *pBmp & m )
-			{
-				if ( col )
-					pImg[ y * sw + ( lx >> 3 ) ] |= xm[ lx & 7 ];
-				else
-					pImg[ y * sw + ( lx >> 3 ) ] &= ~xm[ lx & 7 ];
+int ezd_list_draw( HEZDLIST x_hList, HEZDIMAGE x_hDib )
+{
+	int pos, ok, *v;
+	SListCmd *c;
+	SDrawList *p = (SDrawList*)x_hList;
+	SImageData *d = (SImageData*)x_hDib;
 
-			} // end if
+	if ( !p || !d || sizeof( SBitmapInfoHeader ) != d->bih.biSize )
+		return _ERR( 0, "Invalid parameters" );
 
-			// Next bmp bit
-			m >>= 1;
+	// Skip the whole list if it is outside the clip rect, user callbacks
+	// are passed text outside the image so they always get the list
+	if ( !p->nCmds || ( !EZD_HAS_CALLBACK( d ) && ( p->r <= d->nClipLeft || p->l >= d->nClipRight
+		 || p->b <= d->nClipTop || p->t >= d->nClipBottom ) ) )
+		return 1;
 
-			// Next x pixel
-			lx++;
+	for ( pos = 0; pos < p->nUsed; pos += c->nSize )
+	{
+		c = (SListCmd*)&p->pBuf[ pos ];
+		v = (int*)( c + 1 );
 
-		} // end for
+		// Skip commands outside the clip rect
+		if ( ( EZD_CMD_TEXT != c->nType || !EZD_HAS_CALLBACK( d ) )
+			 && ( c->r <= d->nClipLeft || c->l >= d->nClipRight
+			 || c->b <= d->nClipTop || c->t >= d->nClipBottom ) )
+			continue;
 
-		// Reset x
-		lx = x;
+		switch( c->nType )
+		{
+			case EZD_CMD_FILL :
+				ok = ezd_fill( x_hDib, c->col );
+				break;
 
-		// Reset y
-		y++;
+			case EZD_CMD_SET_PIXEL :
+				ok = ezd_set_pixel( x_hDib, v[ 0 ], v[ 1 ], c->col );
+				break;
 
-	} // end for
+			case EZD_CMD_LINE :
+				ok = ezd_line( x_hDib, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], c->col );
+				break;
 
-}
+			case EZD_CMD_LINE_AA :
+				ok = ezd_line_aa( x_hDib, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], c->col );
+				break;
 
-static void ezd_draw_bmp_24( unsigned char *pImg, int sw, int pw, int inv,
-							 int bw, int bh, const unsigned char *pBmp, int col )
-{
-	int w, h;
-	unsigned char m = 0x80;
-	unsigned char r = col & 0xff;
-	unsigned char g = ( col >> 8 ) & 0xff;
-	unsigned char b = ( col >> 16 ) & 0xff;
+			case EZD_CMD_RECT :
+				ok = ezd_rect( x_hDib, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], c->col );
+				break;
 
-	// Draw the glyph
-	for( h = 0; h < bh; h++ )
-	{
-		// Draw horz line
-		for( w = 0; w < bw; w++ )
-		{
-			// Next glyph byte?
-			if ( !m )
-				m = 0x80, pBmp++;
+			case EZD_CMD_FILL_RECT :
+				ok = ezd_fill_rect( x_hDib, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], c->col );
+				break;
 
-			// Is this pixel on?
-			if ( *pBmp & m )
-				pImg[ 0 ] = r, pImg[ 1 ] = g, pImg[ 2 ] = b;
+			case EZD_CMD_CIRCLE_AA :
+				ok = ezd_circle_aa( x_hDib, v[ 0 ], v[ 1 ], v[ 2 ], c->col );
+				break;
 
-			// Next bmp bit
-			m >>= 1;
+			case EZD_CMD_FILL_ELLIPSE :
+				ok = ezd_fill_ellipse( x_hDib, v[ 0 ], v[ 1 ], v[ 2 ], v[ 3 ], c->col );
+				break;
 
-			// Next pixel
-			pImg += pw;
+			case EZD_CMD_ARC :
+			case EZD_CMD_FILL_PIE :
+			{
+				double *a = (double*)v;
+				int *i = (int*)( a + 2 );
+				ok = ( EZD_CMD_ARC == c->nType )
+					 ? ezd_arc( x_hDib, i[ 0 ], i[ 1 ], i[ 2 ], a[ 0 ], a[ 1 ], c->col )
+					 : ezd_fill_pie( x_hDib, i[ 0 ], i[ 1 ], i[ 2 ], a[ 0 ], a[ 1 ], c->col );
+			} break;
+
+			case EZD_CMD_FILL_POLYGON :
+				ok = ezd_fill_polygon( x_hDib, &v[ 1 ], c->n, c->col, v[ 0 ] );
+				break;
+
+			case EZD_CMD_TEXT :
+			{
+				HEZDFONT *f = (HEZDFONT*)v;
+				int *i = (int*)( f + 1 );
+				ok = ezd_text( x_hDib, *f, (const char*)( i + 2 ), c->n, i[ 0 ], i[ 1 ], c->col );
+			} break;
 
-		} // end for
+			default :
+				return _ERR( 0, "Invalid display list command" );
 
-		// Next image line
-		if ( 0 < inv )
-			pImg += sw - ( bw * pw );
-		else
-			pImg -= sw + ( bw * pw );
+		} // end switch
+
+		if ( !ok )
+			return 0;
 
 	} // end for
 
+	return 1;
 }
 
-static void ezd_draw_bmp_32( unsigned char *pImg, int sw, int pw, int inv,
-							 int bw, int bh, const unsigned char *pBmp, int col )
+/// ezd_render_threads() draw function for ezd_list_draw_threads()
+static int ezd_list_draw_band( void *pList, HEZDIMAGE x_hDib )
 {
-	int w, h;
-	unsigned char m = 0x80;
-
-	// Draw the glyph
-	for( h = 0; h < bh; h++ )
-	{
-		// Draw horz line
-		for( w = 0; w < bw; w++ )
-		{
-			// Next glyph byte?
-			if ( !m )
-				m = 0x80, pBmp++;
-
-			// Is this pixel on?
-			if ( *pBmp & m )
-				*(unsigned int*)pImg = col;
+	return ezd_list_draw( (HEZDLIST)pList, x_hDib );
+}
 
-			// Next bmp bit
-			m >>= 1;
+int ezd_list_draw_threads( HEZDLIST x_hList, HEZDIMAGE x_hDib, int x_nThreads )
+{
+	if ( !x_hList )
+		return _ERR( 0, "Invalid parameters" );
 
-			// Next pixel
-			pImg += pw;
+	return ezd_render_threads( x_hDib, x_nThreads, ezd_list_draw_band, x_hList );
+}
 
-		} // end for
+int ezd_list_fill( HEZDLIST x_hList, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return 0 != ezd_list_add( x_hList, EZD_CMD_FILL, -0x7fffffffLL, -0x7fffffffLL,
+							  0x7fffffffLL, 0x7fffffffLL, x_col, 0, 0 );
+#endif
+}
 
-		// Next image line
-		if ( 0 < inv )
-			pImg += sw - ( bw * pw );
-		else
-			pImg -= sw + ( bw * pw );
+int ezd_list_set_pixel( HEZDLIST x_hList, int x, int y, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_ints( x_hList, EZD_CMD_SET_PIXEL, x, y, (long long)x + 1, (long long)y + 1,
+							  x_col, x, y, 0, 0 );
+#endif
+}
 
-	} // end for
+int ezd_list_line( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_ints( x_hList, EZD_CMD_LINE, ( x1 < x2 ) ? x1 : x2, ( y1 < y2 ) ? y1 : y2,
+							  ( x1 < x2 ) ? (long long)x2 + 1 : (long long)x1 + 1,
+							  ( y1 < y2 ) ? (long long)y2 + 1 : (long long)y1 + 1,
+							  x_col, x1, y1, x2, y2 );
+#endif
+}
 
+int ezd_list_line_aa( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	// Coverage spills one pixel either side
+	return ezd_list_add_ints( x_hList, EZD_CMD_LINE_AA,
+							  ( ( x1 < x2 ) ? x1 : x2 ) - 1LL, ( ( y1 < y2 ) ? y1 : y2 ) - 1LL,
+							  ( ( x1 < x2 ) ? x2 : x1 ) + 2LL, ( ( y1 < y2 ) ? y2 : y1 ) + 2LL,
+							  x_col, x1, y1, x2, y2 );
+#endif
 }
 
-int ezd_text(HEZDIMAGE x_hDib, HEZDFONT x_hFont, const char *x_pText, int x_nTextLen, int x, int y, int x_col)
+int ezd_list_rect( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col )
 {
-	int w, h, sw, pw, inv, i, mh = 0, lx = x;
-	const tGlyph *_pGlyph;
-	SImageData *p = (SImageData*)x_hDib;
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_ints( x_hList, EZD_CMD_RECT, ( x1 < x2 ) ? x1 : x2, ( y1 < y2 ) ? y1 : y2,
+							  ( ( x1 < x2 ) ? x2 : x1 ) + 1LL, ( ( y1 < y2 ) ? y2 : y1 ) + 1LL,
+							  x_col, x1, y1, x2, y2 );
+#endif
+}
 
-#if !defined( EZD_STATIC_FONTS )
-	SFontData *f = (SFontData*)x_hFont;
-	if (!f)
-		return _ERR(0, "Invalid parameters");
+int ezd_list_fill_rect( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_ints( x_hList, EZD_CMD_FILL_RECT, ( x1 < x2 ) ? x1 : x2, ( y1 < y2 ) ? y1 : y2,
+							  ( x1 < x2 ) ? x2 : x1, ( y1 < y2 ) ? y2 : y1,
+							  x_col, x1, y1, x2, y2 );
 #endif
+}
 
-	// Sanity checks
-	if (!p || sizeof(SBitmapInfoHeader) != p->bih.biSize
-		|| (!p->pImage && !p->pfSetPixel))
-		return _ERR(0, "Invalid parameters");
+int ezd_list_arc( HEZDLIST x_hList, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_arc( x_hList, EZD_CMD_ARC, x, y, x_rad, x_dStart, x_dEnd, x_col );
+#endif
+}
 
-	// Calculate image metrics
-	w = EZD_ABS(p->bih.biWidth);
-	h = EZD_ABS(p->bih.biHeight);
+int ezd_list_circle( HEZDLIST x_hList, int x, int y, int x_rad, int x_col )
+{
+	return ezd_list_arc( x_hList, x, y, x_rad, 0, EZD_PI2, x_col );
+}
 
-	// Invert font?
-	inv = ((0 < p->bih.biHeight ? 1 : 0)
-#if !defined( EZD_STATIC_FONTS )
-		^ ((f->uFlags & EZD_FONT_FLAG_INVERT) ? 1 : 0)
+int ezd_list_circle_aa( HEZDLIST x_hList, int x, int y, int x_rad, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_ints( x_hList, EZD_CMD_CIRCLE_AA, (long long)x - x_rad - 1, (long long)y - x_rad - 1,
+							  (long long)x + x_rad + 2, (long long)y + x_rad + 2, x_col, x, y, x_rad, 0 );
 #endif
-		) ? -1 : 1;
+}
 
-	// Pixel and scan width
-	pw = EZD_FITTO(p->bih.biBitCount, 8);
-	sw = EZD_SCANWIDTH(w, p->bih.biBitCount, 4);
+int ezd_list_fill_ellipse( HEZDLIST x_hList, int x, int y, int x_rx, int x_ry, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_ints( x_hList, EZD_CMD_FILL_ELLIPSE, (long long)x - x_rx, (long long)y - x_ry,
+							  (long long)x + x_rx + 1, (long long)y + x_ry + 1, x_col, x, y, x_rx, x_ry );
+#endif
+}
 
-	// For each character in the string
-	for (i = 0; i < x_nTextLen || (0 > x_nTextLen && x_pText[i]); i++)
-	{
-		// Get the specified glyph
-		_pGlyph = ezd_find_glyph(x_hFont, x_pText[i]);
+int ezd_list_fill_circle( HEZDLIST x_hList, int x, int y, int x_rad, int x_col )
+{
+	return ezd_list_fill_ellipse( x_hList, x, y, x_rad, x_rad, x_col );
+}
 
-		// CR, just go back to starting x pos
-		if ('\r' == x_pText[i])
-			lx = x;
+int ezd_list_fill_pie( HEZDLIST x_hList, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	return ezd_list_add_arc( x_hList, EZD_CMD_FILL_PIE, x, y, x_rad, x_dStart, x_dEnd, x_col );
+#endif
+}
 
-		// LF - Back to starting x and next line
-		else if ('\n' == x_pText[i])
-			lx = x, y += inv * (1 + mh), mh = 0;
+int ezd_list_fill_polygon( HEZDLIST x_hList, const int *x_pXy, int x_nPts, int x_col, int x_nRule )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	int i, *v;
+	long long l, t, r, b;
 
-		// Other characters
-		else
-		{
-			int gWidth = (int)(_pGlyph->bbox.width) + (int)(_pGlyph->bbox.xoffset);
-			int gHeight = (int)(_pGlyph->bbox.height) + (int)(_pGlyph->bbox.yoffset);
-			int baselineAKAOriginY = (int)(f->bbox.height) + (int)(f->bbox.yoffset);
-			int bitmapTop = baselineAKAOriginY - gHeight;
-			_SHOW("Glyph '%c' (w,h):%d,%d bl:%d top:%d\n", _pGlyph->encoding, gWidth, gHeight, baselineAKAOriginY, bitmapTop);
-			// Draw this glyph if it's completely on the screen
-			// Let user pfSetPixel to draw outside
-			if ((gWidth && gHeight) && ((p->pfSetPixel != NULL) ||
-				(0 <= lx && (lx + gWidth) < w
-				&& 0 <= y && (y + f->bbox.height) <= h)))
-			{
-				int originX = lx + (int)(_pGlyph->bbox.xoffset);
-				int originY = y + bitmapTop;
-				// Check for user callback function
-				if (p->pfSetPixel)
-					ezd_draw_bmp_cb(p->pImage, originX, originY, sw, pw, inv,
-						_pGlyph->bbox.width, _pGlyph->bbox.height, (const unsigned char*)(_pGlyph + 1), // -> not pointing to next glyph but the data
-						x_col, x_pText[i], p->pfSetPixel, p->pSetPixelUser);
+	if ( !x_pXy || 0 >= x_nPts )
+		return _ERR( 0, "Invalid parameters" );
 
-				else switch (p->bih.biBitCount)
-				{
-				case 1:
-					ezd_draw_bmp_1(p->pImage, originX, originY, sw, pw, inv,
-						_pGlyph->bbox.width, _pGlyph->bbox.height, (const unsigned char*)(_pGlyph + 1), // -> not pointing to next glyph but the data
-						EZD_COMPARE_THRESHOLD(x_col, p->colThreshold));
-					break;
+	// Bounding box of the points
+	l = r = x_pXy[ 0 ], t = b = x_pXy[ 1 ];
+	for ( i = 1; i < x_nPts; i++ )
+	{	if ( x_pXy[ i * 2 ] < l ) l = x_pXy[ i * 2 ];
+		if ( x_pXy[ i * 2 ] > r ) r = x_pXy[ i * 2 ];
+		if ( x_pXy[ i * 2 + 1 ] < t ) t = x_pXy[ i * 2 + 1 ];
+		if ( x_pXy[ i * 2 + 1 ] > b ) b = x_pXy[ i * 2 + 1 ];
+	} // end for
 
-				case 24:
-					ezd_draw_bmp_24(&p->pImage[y * sw + lx * pw], sw, pw, inv,
-						_pGlyph->bbox.width, _pGlyph->bbox.height, (const unsigned char*)(_pGlyph + 1), // -> not pointing to next glyph but the data
-						x_col);
-					break;
+	v = (int*)ezd_list_add( x_hList, EZD_CMD_FILL_POLYGON, l, t, r + 1, b + 1,
+							x_col, x_nPts, ( 1 + x_nPts * 2 ) * sizeof( int ) );
+	if ( !v )
+		return 0;
 
-				case 32:
-					ezd_draw_bmp_32(&p->pImage[y * sw + lx * pw], sw, pw, inv,
-						_pGlyph->bbox.width, _pGlyph->bbox.height, (const unsigned char*)(_pGlyph + 1), // -> not pointing to next glyph but the data
-						x_col);
-					break;
-				} // end switch
+	v[ 0 ] = x_nRule;
+	EZD_MEMCPY( (char*)&v[ 1 ], (const char*)x_pXy, x_nPts * 2 * sizeof( int ) );
 
-			} // end if
+	return 1;
+#endif
+}
 
-			  // Next character position
-			lx += f->spacing + _pGlyph->xoffsetnext;
+int ezd_list_text( HEZDLIST x_hList, HEZDFONT x_hFont, const char *x_pText, int x_nTextLen, int x, int y, int x_col )
+{
+#if defined( EZD_NO_ALLOCATION )
+	return 0;
+#else
+	int *v;
+	HEZDFONT *f;
+	long long box[ 4 ];
 
-			// Track max height
-			mh = (gHeight > mh) ? gHeight : mh;
+	if ( !x_hFont || !x_pText )
+		return _ERR( 0, "Invalid parameters" );
 
-		} // end else
+	// Null terminated?
+	if ( 0 > x_nTextLen )
+		for ( x_nTextLen = 0; x_pText[ x_nTextLen ]; x_nTextLen++ )
+			;
+
+	// Nothing drawn yet
+	box[ 0 ] = box[ 1 ] = 0x7fffffffLL;
+	box[ 2 ] = box[ 3 ] = -0x7fffffffLL;
+	ezd_text_box( x_hFont, x_pText, x_nTextLen, x, y, box );
+	if ( box[ 0 ] >= box[ 2 ] )
+		box[ 0 ] = box[ 1 ] = box[ 2 ] = box[ 3 ] = 0;
+
+	f = (HEZDFONT*)ezd_list_add( x_hList, EZD_CMD_TEXT, box[ 0 ], box[ 1 ], box[ 2 ], box[ 3 ],
+								 x_col, x_nTextLen, sizeof( HEZDFONT ) + 2 * sizeof( int ) + x_nTextLen );
+	if ( !f )
+		return 0;
 
-	} // end for
+	*f = x_hFont;
+	v = (int*)( f + 1 );
+	v[ 0 ] = x, v[ 1 ] = y;
+	EZD_MEMCPY( (char*)&v[ 2 ], x_pText, x_nTextLen );
 
 	return 1;
+#endif
 }
 
 #define EZD_CNVTYPE( t, c ) case EZD_TYPE_##t : return oDst + ( (double)( ((c*)pData)[ i ] ) - oSrc ) * rDst / rSrc;
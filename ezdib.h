@@ -67,10 +67,28 @@ extern "C"
 	typedef struct _HEZDIMAGE *HEZDIMAGE;
 
 	/// Bytes required for image header
-#	define EZD_HEADER_SIZE				128
+#	define EZD_HEADER_SIZE				320
 	
 	/// Set this flag if you will supply your own image buffer using ezd_set_image_buffer()
 #	define EZD_FLAG_USER_IMAGE_BUFFER	0x0001
+
+	/// Set this flag to keep room for the bmp file headers in front of the image, see ezd_get_file()
+#	define EZD_FLAG_FILE_HEADROOM		0x0002
+
+	/// Extra bytes EZD_FLAG_FILE_HEADROOM needs in the image buffer, plus EZD_PALETTE_SIZE()
+#	define EZD_FILE_HEADROOM			96
+
+	/// Bytes a 4 or 8 bit image keeps its palette in after the header
+#	define EZD_PALETTE_SIZE( bpp )		( ( 4 == (bpp) || 8 == (bpp) ) ? 4 << (bpp) : 0 )
+
+	/// Set this flag to make 16 bit images 5-5-5 instead of 5-6-5
+#	define EZD_FLAG_RGB555				0x0004
+
+	/// ezd_open_mapped() flag, map a private copy of the file that can be drawn on
+#	define EZD_MAP_COPY					0x0001
+
+	/// ezd_open_mapped() flag, drawing changes the file, see ezd_sync()
+#	define EZD_MAP_WRITE				0x0002
 	
 	/// Set pixel function typedef.  Supply your own set pixel 
 	/// function to support unbuffered io.
@@ -97,6 +115,90 @@ extern "C"
 		\return Non-zero if success, otherwise zero
 	*/
 	int ezd_set_pixel_callback( HEZDIMAGE x_hDib, t_ezd_set_pixel x_pf, void *x_pUser );
+
+	/// Set in the flags passed to t_ezd_set_span if the span is vertical
+#	define EZD_SPAN_VERTICAL			0x00010000
+
+	/// Set span function typedef.  Supply your own set span
+	/// function to write whole runs of pixels in unbuffered io.
+	/**
+		\param [in] pUser	- User data passed to ezd_set_span_callback()
+		\param [in] x		- X coord of the first pixel
+		\param [in] y		- Y coord of the first pixel
+		\param [in] len		- Number of pixels in the run
+		\param [in] c		- Pixel color
+		\param [in] f		- Flags
+
+		Runs go to the right of x.  Vertical lines are passed as a
+		single run going down from y, with f set to EZD_SPAN_VERTICAL.
+		Otherwise f is the same as the flags passed to t_ezd_set_pixel.
+
+		\return Return non-zero to continue the current drawing operation,
+				return zero to abort.
+	*/
+	typedef int (*t_ezd_set_span)( void *pUser, int x, int y, int len, int c, int f );
+
+	/// Supply your own set span function to support unbuffered io.
+	/**
+		\param [in] x_pf	- Pointer to user set span callback function.
+		\param [in] x_pUser	- Data passed to user callback function.
+
+		Fills, rectangles, straight lines and text rows are passed
+		to this function as whole runs.  If there is also a set pixel
+		callback, it is used for single pixels, otherwise single
+		pixels are passed to this function as runs of one.
+
+		\return Non-zero if success, otherwise zero
+	*/
+	int ezd_set_span_callback( HEZDIMAGE x_hDib, t_ezd_set_span x_pf, void *x_pUser );
+
+	/// Pixel record passed to t_ezd_set_pixels
+	typedef struct _SEZDPixel
+	{
+		/// X coord of pixel
+		int		x;
+
+		/// Y coord of pixel
+		int		y;
+
+		/// Pixel color
+		int		c;
+
+		/// Flags, same as for t_ezd_set_pixel
+		int		f;
+
+	} SEZDPixel;
+
+	/// Set pixels function typedef.  Supply your own set pixels
+	/// function to receive single pixels in batches.
+	/**
+		\param [in] pUser	- User data passed to ezd_set_pixels_callback()
+		\param [in] pPix	- Queued pixels, in drawing order
+		\param [in] nPix	- Number of pixels in pPix
+
+		\return Return non-zero to continue the current drawing operation,
+				return zero to abort.
+	*/
+	typedef int (*t_ezd_set_pixels)( void *pUser, const SEZDPixel *pPix, int nPix );
+
+	/// Queue single pixels and pass them to the user in batches
+	/**
+		\param [in] x_pf	- Pointer to user set pixels callback function,
+							  or zero to stop batching.
+		\param [in] x_pUser	- Data passed to user callback function.
+		\param [in] x_pBuf	- Queue buffer, must stay valid while batching
+		\param [in] x_nBuf	- Number of records in x_pBuf
+
+		While this is set, pixels that would have gone to the set pixel
+		callback are queued in x_pBuf instead.  The queue is passed to
+		x_pf when it is full and at the end of each drawing function,
+		so the callback may sort and coalesce writes.  Runs still go
+		to the set span callback if there is one, after the queue is
+		flushed.
+
+		\return Non-zero if success, otherwise zero
+	*/
+	int ezd_set_pixels_callback( HEZDIMAGE x_hDib, t_ezd_set_pixels x_pf, void *x_pUser, SEZDPixel *x_pBuf, int x_nBuf );
 	
 	/// Returns the size buffer required for image headers
 	/**
@@ -106,6 +208,9 @@ extern "C"
 		If you absolutely must user a static buffer, use EZD_HEADER_SIZE, but
 		be sure and pass EZD_HEADER_SIZE as the second parameter to 
 		ezd_initialize() to help detect space issues ;)
+
+		4 and 8 bit images need EZD_PALETTE_SIZE( bpp ) more bytes
+		for their palette.
 		
 	*/
 	int ezd_header_size();	
@@ -131,6 +236,17 @@ extern "C"
 										  User will provide buffer later by calling
 										  ezd_set_image_buffer().
 
+			EZD_FLAG_FILE_HEADROOM		- Buffer includes EZD_FILE_HEADROOM extra bytes,
+										  plus EZD_PALETTE_SIZE( x_lBpp ), for the file
+										  headers, see ezd_get_file().
+
+			EZD_FLAG_RGB555				- 16 bit pixels are 5-5-5 instead of 5-6-5.
+
+		x_lBpp can be 1, 4, 8, 16, 24 or 32.  1, 4 and 8 bit images
+		have a palette, see ezd_set_palette_color().  4 and 8 bit
+		images keep it right after the header, so the buffer needs
+		EZD_PALETTE_SIZE( x_lBpp ) more bytes.
+
 		\return Image handle or NULL if failure
 
 		\see
@@ -150,6 +266,14 @@ extern "C"
 										  user will provide buffer by calling
 										  ezd_set_image_buffer().
 
+			EZD_FLAG_FILE_HEADROOM		- Leave room in front of the image data
+										  for the file headers, see ezd_get_file().
+
+			EZD_FLAG_RGB555				- 16 bit pixels are 5-5-5 instead of 5-6-5.
+
+		x_lBpp can be 1, 4, 8, 16, 24 or 32.  1, 4 and 8 bit images
+		have a palette, see ezd_set_palette_color().
+
 		\return Image handle or NULL if failure
 
 		\see
@@ -180,7 +304,203 @@ extern "C"
 		
 	*/
 	int ezd_set_image_buffer( HEZDIMAGE x_hDib, void *x_pImg, int x_nImg );	
+
+	/// Draw function typedef for ezd_render_bands(), draws the whole frame
+	/**
+		\param [in] pUser	- User data passed to ezd_render_bands()
+		\param [in] hDib	- Image to draw on
+
+		\return Return non-zero to continue rendering, return zero to abort.
+	*/
+	typedef int (*t_ezd_draw)( void *pUser, HEZDIMAGE hDib );
+
+	/// Band function typedef for ezd_render_bands(), receives each finished band
+	/**
+		\param [in] pUser	- User data passed to ezd_render_bands()
+		\param [in] hDib	- Image being drawn
+		\param [in] y		- First image row in the band
+		\param [in] nRows	- Number of rows in the band
+		\param [in] pBand	- Band pixels, nRows scan lines of ezd_get_stride() bytes
+
+		\return Return non-zero to continue rendering, return zero to abort.
+	*/
+	typedef int (*t_ezd_band)( void *pUser, HEZDIMAGE hDib, int y, int nRows, const void *pBand );
+
+	/// Draws an image a few scan lines at a time
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pBand		- Band buffer
+		\param [in] x_nBand		- Size of x_pBand, at least one scan line
+		\param [in] x_pfDraw	- Draws the frame
+		\param [in] x_pDrawUser	- Data passed to x_pfDraw
+		\param [in] x_pfBand	- Receives each band
+		\param [in] x_pBandUser	- Data passed to x_pfBand
+
+		For targets that can't hold a whole frame, the image only needs
+		a header, see EZD_FLAG_USER_IMAGE_BUFFER.  The image is split
+		into bands of as many scan lines as fit in x_pBand.  For each
+		band, x_pfDraw is called to draw the whole frame in image
+		coordinates, with everything clipped to the band, then the
+		band is passed to x_pfBand.  Rows are in image order, with
+		ezd_get_stride() bytes per row.
+
+		The frame must be drawn the same way for every band.  While
+		rendering, only the current band's rows can be read back, and
+		ezd_set_clip_rect() is limited to the band.  The image buffer
+		and clip rect are restored when done.
+
+		\return Non zero on success
+	*/
+	int ezd_render_bands( HEZDIMAGE x_hDib, void *x_pBand, int x_nBand,
+						  t_ezd_draw x_pfDraw, void *x_pDrawUser, t_ezd_band x_pfBand, void *x_pBandUser );
+
+	/// Draws an image in bands on several threads
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_nThreads	- Number of threads, zero or less to use
+								  one per processor
+		\param [in] x_pfDraw	- Draws the frame
+		\param [in] x_pUser		- Data passed to x_pfDraw
+
+		The image is split into horizontal bands that are handed out
+		to the threads.  x_pfDraw is called once per band, on any of
+		the threads, with a handle that draws into the image but is
+		clipped to the band, so the threads never write the same
+		pixels.  As with ezd_render_bands(), x_pfDraw must draw the
+		whole frame the same way every time, and the output matches
+		drawing the frame on one thread exactly.
+
+		x_pfDraw must only draw through the handle it is passed and
+		must not read pixels outside its band.  Images with user
+		callbacks, or builds with EZD_NO_THREADS, call x_pfDraw once
+		on the calling thread.
+
+		\return Non zero on success, zero if any call to x_pfDraw failed
+	*/
+	int ezd_render_threads( HEZDIMAGE x_hDib, int x_nThreads, t_ezd_draw x_pfDraw, void *x_pUser );
 	
+	/// Write function typedef for ezd_save_stream()
+	/**
+		\param [in] pUser	- User data passed to ezd_save_stream()
+		\param [in] pData	- Data to write
+		\param [in] nData	- Number of bytes in pData
+
+		\return Return non-zero if all of pData was written, return
+				zero to abort.
+	*/
+	typedef int (*t_ezd_write)( void *pUser, const void *pData, int nData );
+
+	/// Writes the DIB as a bmp file through a write function
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pfWrite	- Receives the file a block at a time
+		\param [in] x_pUser		- Data passed to x_pfWrite
+
+		The headers are written first, then the image a few rows at a
+		time straight from the image buffer.  Images without a buffer
+		are read back from the set pixel callback, called with -1 as
+		the flags, and written as 24 bit a part of a row at a time, so
+		no copy of the image is made.
+
+		\return Non zero on success
+	*/
+	int ezd_save_stream( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser );
+
+	/// Returns the size of the bmp file the image saves as
+	/**
+		\param [in] x_hDib		- Handle to a dib
+
+		\return File size in bytes, zero on failure
+	*/
+	int ezd_get_file_size( HEZDIMAGE x_hDib );
+
+	/// Writes the DIB as a bmp file to memory
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pBuf		- Receives the file
+		\param [in] x_nBuf		- Size of x_pBuf, at least ezd_get_file_size()
+
+		\return Number of bytes written, zero on failure
+	*/
+	int ezd_save_mem( HEZDIMAGE x_hDib, void *x_pBuf, int x_nBuf );
+
+	/// Returns the image as a bmp file without copying the pixels
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [out] x_pSize	- Receives the file size, can be null
+
+		The image must have been created with EZD_FLAG_FILE_HEADROOM
+		and be using its own image buffer.  The file headers are
+		written into the room in front of the pixels, so the whole
+		file is one block of memory that can be sent as is.  It stays
+		valid until the image is destroyed, call again after changing
+		the palette.
+
+		\return Pointer to the file, or null on failure
+	*/
+	const void* ezd_get_file( HEZDIMAGE x_hDib, int *x_pSize );
+
+	/// Opens a bmp file as an image without reading it
+	/**
+		\param [in] x_pFile		- Bmp filename
+		\param [in] x_uFlags	- Flags
+
+		x_uFlags
+
+			EZD_MAP_COPY			- Map a private copy of the file.  Drawing
+									  changes the image but not the file, and
+									  only the pages drawn on are copied.
+
+			EZD_MAP_WRITE			- Drawing changes the file, see ezd_sync().
+
+		The file is mapped into memory and the image draws and reads
+		straight from its pixels, so opening even a very large file
+		is quick.  Without EZD_MAP_COPY or EZD_MAP_WRITE the pixels
+		are read only, drawing on the image fails and it can only be
+		read, for example as a source for ezd_blit().
+
+		Uncompressed 1, 4, 8, 16, 24 and 32 bit files are supported,
+		16 bit files with 5-6-5 bit fields or as 5-5-5.  Pixels are
+		used where they are in the file, so processors that need
+		aligned access also need 32 bit files with a pixel offset
+		that is a multiple of four.
+
+		Call ezd_destroy() to close the file.
+
+		\return Image handle or NULL if failure
+	*/
+	HEZDIMAGE ezd_open_mapped( const char *x_pFile, unsigned int x_uFlags );
+
+	/// Creates a bmp file and an image that draws straight into it
+	/**
+		\param [in] x_pFile		- New image filename
+		\param [in] x_lWidth	- Image width
+		\param [in] x_lHeight	- Image height
+		\param [in] x_lBpp		- Image bits per pixel, 1, 4, 8, 16, 24 or 32
+
+		The file is created at its full size with the headers filled
+		in, and its pixels are mapped as the image buffer, so the image
+		never needs memory of its own.  Instead of ezd_save(), call
+		ezd_sync() to make sure the file is up to date.  The file
+		starts out black.  The pixels must fit in 2 GB.
+
+		Call ezd_destroy() to close the file.
+
+		\return Image handle or NULL if failure
+	*/
+	HEZDIMAGE ezd_create_mapped( const char *x_pFile, int x_lWidth, int x_lHeight, int x_lBpp );
+
+	/// Writes changes to an image mapped for writing out to its file
+	/**
+		\param [in] x_hDib		- Image from ezd_create_mapped(), or ezd_open_mapped()
+								  with EZD_MAP_WRITE
+
+		Also writes the palette of 1, 4 and 8 bit images.
+
+		\return Non zero on success
+	*/
+	int ezd_sync( HEZDIMAGE x_hDib );
+
 	/// Writes the DIB to a file
 	/**
 		\param [in] x_hDib		- Handle to a dib
@@ -190,6 +510,89 @@ extern "C"
 	*/
 	int ezd_save( HEZDIMAGE x_hDib, const char *x_pFile );
 
+	/// Writes the DIB as a run length encoded bmp file through a write function
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pfWrite	- Receives the file a block at a time
+		\param [in] x_pUser		- Data passed to x_pfWrite
+
+		The palette is taken from the colors the image uses, 1 bit
+		images use their own.  1, 4 and 8 bit images can always be
+		compressed.  Images with up to 16 colors are written
+		as BI_RLE4, up to 256 as BI_RLE8, and images with more colors
+		are written uncompressed like ezd_save_stream().  The alpha of
+		32 bit images is not kept.
+
+		The image is read three times, once for the palette, once for
+		the compressed size and once to write it, so only a row is
+		ever held in memory.
+
+		\return Non zero on success
+	*/
+	int ezd_save_rle_stream( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser );
+
+	/// Writes the DIB as a run length encoded bmp file to memory
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pBuf		- Receives the file, or null to get the size
+		\param [in] x_nBuf		- Size of x_pBuf
+
+		\return Number of bytes written, zero on failure or if
+				x_pBuf is too small
+	*/
+	int ezd_save_rle_mem( HEZDIMAGE x_hDib, void *x_pBuf, int x_nBuf );
+
+	/// Writes the DIB to a run length encoded bmp file
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pFile		- New image filename
+
+		\return Non zero on success
+	*/
+	int ezd_save_rle( HEZDIMAGE x_hDib, const char *x_pFile );
+
+	/// Writes the DIB as a png file through a write function
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pfWrite	- Receives the file a block at a time
+		\param [in] x_pUser		- Data passed to x_pfWrite
+
+		1, 4 and 8 bit images are written with their palette, 16 and
+		24 bit images as RGB, and 32 bit images as RGB, or as RGBA in the
+		alpha modes, see ezd_set_alpha_mode().  Images without a
+		buffer are read back from the set pixel callback like
+		ezd_save_stream().
+
+		Each row gets the filter that looks like it will compress
+		best, and the rows are compressed with a fast deflate that
+		suits flat colored images.  Chunks of rows are compressed on
+		separate threads, see EZD_PNG_THREADS, and written as they
+		are done, so only a few chunks are ever in memory.
+
+		\return Non zero on success
+	*/
+	int ezd_save_png_stream( HEZDIMAGE x_hDib, t_ezd_write x_pfWrite, void *x_pUser );
+
+	/// Writes the DIB as a png file to memory
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pBuf		- Receives the file, or null to get the size
+		\param [in] x_nBuf		- Size of x_pBuf
+
+		\return Number of bytes written, zero on failure or if
+				x_pBuf is too small
+	*/
+	int ezd_save_png_mem( HEZDIMAGE x_hDib, void *x_pBuf, int x_nBuf );
+
+	/// Writes the DIB to a png file
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pFile		- New image filename
+
+		\return Non zero on success
+	*/
+	int ezd_save_png( HEZDIMAGE x_hDib, const char *x_pFile );
+
 	/// Sets the threshold color for 1 bit images
 	/**
 		\param [in] x_hDib		- Handle to a dib
@@ -202,14 +605,98 @@ extern "C"
 	*/
 	int ezd_set_color_threshold( HEZDIMAGE x_hDib, int x_col );
 
+	/// Colors are written as is
+#	define EZD_ALPHA_NONE			0
+
+	/// Colors are blended using the alpha in their top byte
+#	define EZD_ALPHA_BLEND			1
+
+	/// Like EZD_ALPHA_BLEND, but colors are premultiplied by their alpha
+#	define EZD_ALPHA_PREMULTIPLIED	2
+
+	/// Sets how colors are combined with a 32 bit image
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_nMode		- EZD_ALPHA_NONE, EZD_ALPHA_BLEND
+								  or EZD_ALPHA_PREMULTIPLIED
+
+		In the alpha modes, the top byte of a color is its alpha,
+		0xff is opaque and zero is transparent, and drawing
+		composites the color over the image.  ezd_blit() composites
+		32 bit sources using their own alpha, other sources are
+		opaque.  ezd_flood_fill() writes the fill color directly,
+		and colors passed to the user callbacks are not blended.
+
+		In EZD_ALPHA_BLEND mode the image color is treated as
+		opaque, the image alpha becomes the coverage of everything
+		drawn over it.
+
+		Premultiplied colors must not be larger than their alpha,
+		the components are limited to it.
+
+		\return Non zero on success
+	*/
+	int ezd_set_alpha_mode( HEZDIMAGE x_hDib, int x_nMode );
+
+	/// Restricts drawing to the specified rectangle
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x1			- Left edge
+		\param [in] y1			- Top edge
+		\param [in] x2			- Right edge, not included
+		\param [in] y2			- Bottom edge, not included
+
+		The rectangle is limited to the image.  All drawing
+		functions are clipped to it, lines are clipped before
+		they are stepped so coordinates far outside the image
+		cost nothing.
+
+		\return Non zero on success
+	*/
+	int ezd_set_clip_rect( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2 );
+
+	/// Resets the clip rectangle to the whole image
+	/**
+		\param [in] x_hDib		- Handle to a dib
+
+		\return Non zero on success
+	*/
+	int ezd_reset_clip_rect( HEZDIMAGE x_hDib );
+
+	/// Returns the parts of the image drawn on since ezd_clear_dirty()
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [out] x_pRects	- Receives x1, y1, x2, y2 for each rect, can be null
+		\param [in] x_nMax		- Number of rects x_pRects can hold
+
+		Each drawing function adds the box it could have drawn in,
+		limited to the clip rect.  Up to EZD_DIRTY_RECTS separate rects
+		are kept, after that a new box is merged into the rect it
+		grows the least.  The rects can overlap, and as with the clip
+		rect, right and bottom are exclusive.
+
+		\return Number of dirty rects, which may be more than x_nMax
+	*/
+	int ezd_get_dirty_rects( HEZDIMAGE x_hDib, int *x_pRects, int x_nMax );
+
+	/// Marks the whole image as unchanged
+	/**
+		\param [in] x_hDib		- Handle to a dib
+
+		\return Non zero on success
+	*/
+	int ezd_clear_dirty( HEZDIMAGE x_hDib );
+
 	/// Sets the specified color in the color palette
 	/**
 		\param [in] x_hDib		- Handle to a dib
 		\param [in] x_idx		- Color index to set
 		\param [in] x_col		- Threshold color
 
-		Currently, this library only supports 1 bit images with
-		color palettes.  So x_idx must be zero or one.
+		x_idx must be less than ezd_get_palette_size().  4 and 8 bit
+		images start with the 16 VGA colors, or a 6x6x6 color cube
+		and a gray ramp.  Colors drawn on them use the nearest palette
+		color.
 
 		\return Non zero on success
 	*/
@@ -221,17 +708,20 @@ extern "C"
 		\param [in] x_idx		- Color index to set
 		\param [in] x_col		- Threshold color
 
-		Currently, this library only supports 1 bit images with
-		color palettes.  So x_idx must be zero or one.
+		x_idx must be less than ezd_get_palette_size().
 
 		\return Color of the specified palette index or zero if failure
 	*/
 	int ezd_get_palette_color( HEZDIMAGE x_hDib, int x_idx, int x_col );
 
-	/// Returns the number of color entries in the palette
+	/// Returns the number of color entries in the palette, 2, 16, 256 or zero
+	/**
+		4 and 8 bit files opened with ezd_open_mapped() may have
+		fewer colors, drawing on them only uses those.
+	*/
 	int ezd_get_palette_size( HEZDIMAGE x_hDib );
 
-	/// Returns a pointer to the palette
+	/// Returns a pointer to the palette, which can be changed through it
 	int* ezd_get_palette( HEZDIMAGE x_hDib );
 
 	/// Fills the image with the specified color
@@ -258,6 +748,22 @@ extern "C"
 	/// Returns a raw image
 	void* ezd_get_image_ptr( HEZDIMAGE x_hDib );
 
+	/// Returns the number of bytes between the start of each row
+	int ezd_get_stride( HEZDIMAGE x_hDib );
+
+	/// Returns a pointer to the specified row
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] y			- Row index
+
+		Row y is at ezd_get_image_ptr() + y * ezd_get_stride(),
+		the same row the drawing functions use for coordinate y.
+
+		\return Pointer to the row, or null if y is out of range
+				 or there is no image buffer
+	*/
+	void* ezd_get_row( HEZDIMAGE x_hDib, int y );
+
 	/// Sets the specified pixel color
 	/**
 		\param [in] x_hDib		- Handle to a dib
@@ -279,6 +785,55 @@ extern "C"
 	*/
 	int ezd_get_pixel( HEZDIMAGE x_hDib, int x, int y );
 
+	/// Sets a list of pixels to the same color
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pXy		- Pixel coords, x0, y0, x1, y1, ...
+		\param [in] x_nPts		- Number of pixels in x_pXy
+		\param [in] x_col		- Pixel color
+
+		Points outside the clip rect are skipped.  The handle is
+		only checked once, so this is much faster than calling
+		ezd_set_pixel() for each point.
+
+		\return Non zero on success
+	*/
+	int ezd_set_pixels( HEZDIMAGE x_hDib, const int *x_pXy, int x_nPts, int x_col );
+
+	/// Sets a list of pixels, each to its own color
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pXy		- Pixel coords, x0, y0, x1, y1, ...
+		\param [in] x_pCol		- One color for each pixel
+		\param [in] x_nPts		- Number of pixels
+
+		\return Non zero on success
+	*/
+	int ezd_set_pixels_colors( HEZDIMAGE x_hDib, const int *x_pXy, const int *x_pCol, int x_nPts );
+
+	/// Copies a block of pixels from one image to another
+	/**
+		\param [in] x_hDst		- Destination image
+		\param [in] x_dx		- Destination X coord
+		\param [in] x_dy		- Destination Y coord
+		\param [in] x_hSrc		- Source image, must have an image buffer
+		\param [in] x_sx		- Source X coord
+		\param [in] x_sy		- Source Y coord
+		\param [in] x_w			- Block width
+		\param [in] x_h			- Block height
+
+		The block is clipped to the source image and the destination
+		clip rect.  Pixels are converted between formats, palette
+		sources use their palette, 1 bit destinations use their
+		threshold color and 4 and 8 bit destinations the nearest
+		palette color.  If one image is top down and the other bottom
+		up, the rows are flipped so the block stays the right way up.
+		Overlapping copies within one image are allowed.
+
+		\return Non zero on success
+	*/
+	int ezd_blit( HEZDIMAGE x_hDst, int x_dx, int x_dy, HEZDIMAGE x_hSrc, int x_sx, int x_sy, int x_w, int x_h );
+
 
 	/// Draws a line between the specified points
 	/**
@@ -293,6 +848,24 @@ extern "C"
 	*/
 	int ezd_line( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col );
 
+	/// Draws an anti-aliased line between the specified points
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x1			- First X coord
+		\param [in] y1			- First Y coord
+		\param [in] x2			- Second X coord
+		\param [in] y2			- Second Y coord
+		\param [in] x_col		- Line color
+
+		Each step along the line is shared between the two nearest
+		pixels by their distance from it, and the color is blended
+		into the image by that coverage.  1 bit images and user
+		callbacks get the pixels that are at least half covered.
+
+		\return Non zero on success
+	*/
+	int ezd_line_aa( HEZDIMAGE x_hDib, int x1, int y1, int x2, int y2, int x_col );
+
 	/// Fills the specified rectangle
 	/**
 		\param [in] x_hDib		- Handle to a dib
@@ -329,6 +902,9 @@ extern "C"
 		\param [in] dEnd		- End angle
 		\param [in] x_col		- Line color
 
+		Angles are in radians, measured from the positive x axis
+		towards positive y.
+
 		\return Non zero on success
 	*/
 	int ezd_arc( HEZDIMAGE x_hDib, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col );
@@ -345,6 +921,83 @@ extern "C"
 	*/
 	int ezd_circle( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col );
 
+	/// Draws an anti-aliased circle outline
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x			- Center X coord
+		\param [in] y			- Center Y coord
+		\param [in] x_rad		- Radius, up to 32767
+		\param [in] x_col		- Line color
+
+		Coverage is handled the same as ezd_line_aa().
+
+		\return Non zero on success
+	*/
+	int ezd_circle_aa( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col );
+
+	/// Draw filled circle
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x			- Center X coord
+		\param [in] y			- Center Y coord
+		\param [in] r			- Radius
+		\param [in] x_col		- Fill color
+
+		\return Non zero on success
+	*/
+	int ezd_fill_circle( HEZDIMAGE x_hDib, int x, int y, int x_rad, int x_col );
+
+	/// Draw filled ellipse
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x			- Center X coord
+		\param [in] y			- Center Y coord
+		\param [in] x_rx		- Horizontal radius
+		\param [in] x_ry		- Vertical radius
+		\param [in] x_col		- Fill color
+
+		\return Non zero on success
+	*/
+	int ezd_fill_ellipse( HEZDIMAGE x_hDib, int x, int y, int x_rx, int x_ry, int x_col );
+
+	/// Draw filled pie slice
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x			- Center X coord
+		\param [in] y			- Center Y coord
+		\param [in] r			- Radius
+		\param [in] dStart		- Start angle
+		\param [in] dEnd		- End angle
+		\param [in] x_col		- Fill color
+
+		Angles are the same as for ezd_arc().
+
+		\return Non zero on success
+	*/
+	int ezd_fill_pie( HEZDIMAGE x_hDib, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col );
+
+	/// Fill a pixel if it is inside an odd number of polygon edges
+#	define EZD_FILL_EVENODD			0
+
+	/// Fill a pixel if the polygon winds around it
+#	define EZD_FILL_NONZERO			1
+
+	/// Draw filled polygon
+	/**
+		\param [in] x_hDib		- Handle to a dib
+		\param [in] x_pXy		- Vertex coords, x0, y0, x1, y1, ...
+		\param [in] x_nPts		- Number of vertices in x_pXy
+		\param [in] x_col		- Fill color
+		\param [in] x_nRule		- EZD_FILL_EVENODD or EZD_FILL_NONZERO
+
+		The polygon is closed automatically.  A pixel is filled if
+		its center is inside the polygon, so polygons that share an
+		edge do not overlap.
+
+		\return Non zero on success
+	*/
+	int ezd_fill_polygon( HEZDIMAGE x_hDib, const int *x_pXy, int x_nPts, int x_col, int x_nRule );
+
 	/// Flood fill starting at the specified point
 	/**
 		\param [in] x_hDib		- Handle to a dib
@@ -352,6 +1005,14 @@ extern "C"
 		\param [in] y			- Start Y coord
 		\param [in] x_bcol		- Border color
 		\param [in] x_col		- Fill color
+
+		Fills the connected pixels that are neither the border nor
+		the fill color.  Colors are compared as pixels, so on 4, 8
+		and 16 bit images colors that map to the same pixel match.
+		For 1 bit images, the border color is ignored and the
+		connected pixels not already the fill color are filled.
+
+		\return Non zero on success
 	*/
 	int ezd_flood_fill( HEZDIMAGE x_hDib, int x, int y, int x_bcol, int x_col );
 
@@ -445,6 +1106,112 @@ extern "C"
 	*/
 	int ezd_text_size( HEZDFONT x_hFont, const char *x_pText, int x_nTextLen, int *pw, int *ph );
 
+	//--------------------------------------------------------------
+	// Display lists
+	//--------------------------------------------------------------
+
+	// Declare handle
+	struct _HEZDLIST;
+	typedef struct _HEZDLIST *HEZDLIST;
+
+	/// Creates an empty display list
+	/**
+		A display list records drawing calls so they can be drawn
+		again later on any image.  Each command keeps the box it can
+		touch, and commands outside the image's clip rect are skipped
+		when the list is drawn.
+
+		\return Display list handle or NULL if failure
+	*/
+	HEZDLIST ezd_list_create();
+
+	/// Releases a display list
+	void ezd_list_destroy( HEZDLIST x_hList );
+
+	/// Removes all commands from a display list, keeping its memory
+	/**
+		\param [in] x_hList		- Handle to a display list
+
+		\return Non zero on success
+	*/
+	int ezd_list_clear( HEZDLIST x_hList );
+
+	/// Returns the number of commands in a display list
+	int ezd_list_get_count( HEZDLIST x_hList );
+
+	/// Draws the commands in a display list on an image
+	/**
+		\param [in] x_hList		- Handle to a display list
+		\param [in] x_hDib		- Image to draw on
+
+		Commands are drawn in the order they were recorded, and are
+		clipped to the image's clip rect as usual.
+
+		\return Non zero on success, zero if a command fails
+	*/
+	int ezd_list_draw( HEZDLIST x_hList, HEZDIMAGE x_hDib );
+
+	/// Draws a display list on an image using several threads
+	/**
+		\param [in] x_hList		- Handle to a display list
+		\param [in] x_hDib		- Image to draw on
+		\param [in] x_nThreads	- Number of threads, zero or less to use
+								  one per processor
+
+		Replays the list with ezd_render_threads(), the result is the
+		same as ezd_list_draw().  The list and any fonts it uses must
+		not change while drawing.
+
+		\return Non zero on success, zero if a command fails
+	*/
+	int ezd_list_draw_threads( HEZDLIST x_hList, HEZDIMAGE x_hDib, int x_nThreads );
+
+	/// Records ezd_fill()
+	int ezd_list_fill( HEZDLIST x_hList, int x_col );
+
+	/// Records ezd_set_pixel()
+	int ezd_list_set_pixel( HEZDLIST x_hList, int x, int y, int x_col );
+
+	/// Records ezd_line()
+	int ezd_list_line( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col );
+
+	/// Records ezd_line_aa()
+	int ezd_list_line_aa( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col );
+
+	/// Records ezd_rect()
+	int ezd_list_rect( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col );
+
+	/// Records ezd_fill_rect()
+	int ezd_list_fill_rect( HEZDLIST x_hList, int x1, int y1, int x2, int y2, int x_col );
+
+	/// Records ezd_arc()
+	int ezd_list_arc( HEZDLIST x_hList, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col );
+
+	/// Records ezd_circle()
+	int ezd_list_circle( HEZDLIST x_hList, int x, int y, int x_rad, int x_col );
+
+	/// Records ezd_circle_aa()
+	int ezd_list_circle_aa( HEZDLIST x_hList, int x, int y, int x_rad, int x_col );
+
+	/// Records ezd_fill_ellipse()
+	int ezd_list_fill_ellipse( HEZDLIST x_hList, int x, int y, int x_rx, int x_ry, int x_col );
+
+	/// Records ezd_fill_circle()
+	int ezd_list_fill_circle( HEZDLIST x_hList, int x, int y, int x_rad, int x_col );
+
+	/// Records ezd_fill_pie()
+	int ezd_list_fill_pie( HEZDLIST x_hList, int x, int y, int x_rad, double x_dStart, double x_dEnd, int x_col );
+
+	/// Records ezd_fill_polygon(), the points are copied
+	int ezd_list_fill_polygon( HEZDLIST x_hList, const int *x_pXy, int x_nPts, int x_col, int x_nRule );
+
+	/// Records ezd_text()
+	/**
+		The text is copied, but the font is not, it must stay valid
+		while the list is in use.
+	*/
+	int ezd_list_text( HEZDLIST x_hList, HEZDFONT x_hFont, const char *x_pText, int x_nTextLen, int x, int y, int x_col );
+
 	//--------------------------------------------------------------
 	// Graph functions
 	//--------------------------------------------------------------
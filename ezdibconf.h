@@ -33,12 +33,60 @@ extern "C"
 	*/
 	// #define EZD_NO_FILES
 
-	/// If you do not have math.h.  Sorry, you won't get circles
+	/// If you do not have mmap() or MapViewOfFile()
 	/**
-	ezd_circle() and ezd_arc() will not work
+		ezd_open_mapped(), ezd_create_mapped() and ezd_sync() will not work
+	*/
+	// #define EZD_NO_MMAP
+
+	/// If you do not have math.h
+	/**
+	ezd_arc() will use a slower internal sine and cosine for
+	the end points
 	*/
 	// #define EZD_NO_MATH
 
+	/// Define to disable the SSE2 / AVX2 fill kernels
+	/**
+		The AVX2 kernels are selected at runtime, so the library will
+		still run on processors that only support SSE2.
+	*/
+	// #define EZD_NO_SIMD
+
+	/// Fills larger than this many bytes use non-temporal stores
+	/**
+		This keeps a full frame clear from evicting the rest of the
+		cache.  Set it to zero to always use normal stores.
+	*/
+#if !defined( EZD_STREAM_THRESHOLD )
+#	define EZD_STREAM_THRESHOLD		( 4 * 1024 * 1024 )
+#endif
+
+	/// Number of dirty rects each image keeps
+	/**
+		See ezd_get_dirty_rects(), the image header must still fit
+		in EZD_HEADER_SIZE.
+	*/
+#if !defined( EZD_DIRTY_RECTS )
+#	define EZD_DIRTY_RECTS			3
+#endif
+
+	/// Define if you do not have threads
+	/**
+		ezd_render_threads() will draw on the calling thread
+	*/
+	// #define EZD_NO_THREADS
+
+	/// Most threads ezd_render_threads() will start
+#if !defined( EZD_MAX_THREADS )
+#	define EZD_MAX_THREADS			64
+#endif
+
+	/// Threads ezd_save_png_stream() compresses with, zero for one per processor
+#if !defined( EZD_PNG_THREADS )
+#	define EZD_PNG_THREADS			0
+#endif
+
 	// Debugging
 #if defined( _DEBUG )
 #	define EZD_DEBUG
@@ -74,6 +122,31 @@ extern "C"
 #	define EZD_STATIC_FONTS
 	// Assume our debug functions won't work either
 #	undef EZD_DEBUG
+#endif
+
+	// File mapping
+#if defined( EZD_NO_FILES ) || defined( EZD_NO_ALLOCATION )
+#	define EZD_NO_MMAP
+#endif
+#if !defined( EZD_NO_MMAP )
+#	if defined( _WIN32 )
+#		include <windows.h>
+#	else
+#		include <sys/mman.h>
+#		include <sys/stat.h>
+#		include <fcntl.h>
+#		include <unistd.h>
+#	endif
+#endif
+
+	// Threads and mutexes
+#if !defined( EZD_NO_THREADS )
+#	if defined( _WIN32 )
+#		include <windows.h>
+#	else
+#		include <pthread.h>
+#		include <unistd.h>
+#	endif
 #endif
 
 	// sin(), cos()
@@ -85,20 +158,57 @@ extern "C"
 #if defined( EZD_NO_MEMCPY )
 #	define EZD_MEMCPY ezd_memcpy
 #	define EZD_MEMSET ezd_memset
+#	define EZD_MEMMOVE ezd_memmove
+#	define EZD_MEMCMP ezd_memcmp
 	static void ezd_memcpy(char *pDst, const char *pSrc, int sz)
 	{
 		while (0 < sz--)
 			*(char*)pDst++ = *(char*)pSrc++;
 	}
+	static void ezd_memmove(char *pDst, const char *pSrc, int sz)
+	{
+		if (pDst <= pSrc)
+			ezd_memcpy(pDst, pSrc, sz);
+		else
+			while (0 < sz--)
+				pDst[sz] = pSrc[sz];
+	}
 	static void ezd_memset(char *pDst, int v, int sz)
 	{
 		while (0 < sz--)
 			*(char*)pDst++ = (char)v;
 	}
+	static int ezd_memcmp(const unsigned char *p1, const unsigned char *p2, int sz)
+	{
+		for (; 0 < sz--; p1++, p2++)
+			if (*p1 != *p2)
+				return *p1 - *p2;
+		return 0;
+	}
 #else
 #	include <string.h>
 #	define EZD_MEMCPY memcpy
 #	define EZD_MEMSET memset
+#	define EZD_MEMMOVE memmove
+#	define EZD_MEMCMP memcmp
+#endif
+
+	// SSE2 is always available on x64, AVX2 is detected at runtime
+#if !defined( EZD_NO_SIMD )
+#	if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && 2 <= _M_IX86_FP )
+#		define EZD_SSE2
+#		include <emmintrin.h>
+#		if defined( __GNUC__ ) && ( 4 < __GNUC__ || ( 4 == __GNUC__ && 9 <= __GNUC_MINOR__ ) || defined( __clang__ ) )
+#			define EZD_AVX2
+#			define EZD_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#			include <immintrin.h>
+#		elif defined( _MSC_VER ) && 1700 <= _MSC_VER
+#			define EZD_AVX2
+#			define EZD_TARGET_AVX2
+#			include <immintrin.h>
+#			include <intrin.h>
+#		endif
+#	endif
 #endif
 
 #if defined( EZD_DEBUG )